@@ -0,0 +1,23 @@
+/*
+ * ioc.cpp - Compiles the non-template core of the IOC container once
+ * for programs built with IOC_SEPARATE_COMPILATION defined.
+ *
+ * Copyright (c) 2012 Nicholas A. Smith (nickrmc83@gmail.com)
+ * Distributed under the Boost software license 1.0,
+ * see boost.org for a copy.
+ */
+
+#if !defined(IOC_SEPARATE_COMPILATION)
+#define IOC_SEPARATE_COMPILATION
+#endif
+
+#include "ioc_impl.h"
+
+namespace ioc
+{
+    template class basic_epoch_domain<void>;
+    template class basic_type_ids<void>;
+    template class basic_reclamation_queue<void>;
+    template class basic_resolve_tracer<void>;
+    template class basic_container<void>;
+}
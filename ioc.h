@@ -18,6 +18,38 @@
 #include <cstring>
 #include <memory>
 #include <typeindex>
+#include <type_traits>
+#include <atomic>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <algorithm>
+#include <iterator>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <exception>
+#include <iosfwd>
+
+#include "ioc_fwd.h"
+
+// The non-template core is defined inline in this header unless
+// IOC_SEPARATE_COMPILATION is defined. It must then be defined for
+// every translation unit and the program linked with ioc.cpp.
+// Virtual functions defined with the core are declared IOC_DECL in
+// their class too. Header only, their class then has no key function
+// and its vtable, with everything the vtable calls, is only emitted
+// where an object of the class is constructed. The container itself
+// is a template over an unused parameter, so header only a
+// translation unit instantiates no more of it than it uses, and with
+// IOC_SEPARATE_COMPILATION its one instantiation is in ioc.cpp.
+#if defined(IOC_SEPARATE_COMPILATION)
+#define IOC_DECL
+#else
+#define IOC_DECL inline
+#endif
 
 namespace ioc
 {
@@ -27,401 +59,3729 @@ namespace ioc
     static const std::string 
         unnamed_type_name_registration = "Unnamed registration";
 
-    class container;
 
-    // ifactory is the base interface for a factory 
-    // type. CreateItem returns a void * which can
-    // then be reinterpret_cast'd to the required type.
-    class ifactory 
+    // Registration names are interned so that each distinct name is
+    // held once no matter how many factories, registrations and
+    // containers use it. Each name counts the interned_name handles
+    // holding it and is freed with the last of them, so names made at
+    // runtime, such as per tenant or manifest names, go once nothing
+    // registered under them remains. usage() reports the table's size.
+    // The table is split into independently locked shards so
+    // registrations in different containers rarely contend.
+    class name_table
     {
         public:
-            virtual ~ifactory(){}
-            virtual const std::type_info &get_type() const = 0;
-            virtual const std::string &get_name() const = 0;
-            virtual void* create_item() const = 0;
+            struct entry
+            {
+                std::string text;
+                mutable std::atomic<size_t> references;
+
+                explicit entry( const std::string &text_in )
+                    : text( text_in ), references( 0 )
+                {
+                }
+            };
+
+        private:
+            // Interned names, defined with the container core
+            struct storage;
+
+            static storage &instance();
+
+        public:
+            // The entry for a name, holding a reference for the caller
+            static const entry *intern( const std::string &name );
+
+            // Drop a reference, freeing the entry with the last one
+            static void release( const entry *name );
+
+            // Approximate heap bytes used by one interned name
+            static size_t footprint( const std::string *name );
+
+            // Approximate heap bytes used by every name interned now
+            static size_t usage();
     };
 
-    // BaseFatory extends ifactory to provide some standard
-    // functionality that is required by most concrete
-    // factoy types.
-    template<typename I>
-        class base_factory : public ifactory
+    // A reference to an interned name. While one is held every
+    // interning of the same text returns the same address, so holders
+    // compare names by address.
+    class interned_name
     {
         private:
-            std::string name;
-            virtual I *internal_create_item() const = 0;
+            const name_table::entry *held;
 
         public:
+            interned_name() : held( NULL )
+            {
+            }
 
-            base_factory( const std::string &name_in ) 
-                : ifactory(), name( name_in )
+            explicit interned_name( const std::string &name )
+                : held( name_table::intern( name ) )
             {
             }
 
-            ~base_factory()
+            interned_name( const interned_name &other ) : held( other.held )
             {
+                if( held )
+                {
+                    held->references.fetch_add( 1, std::memory_order_relaxed );
+                }
             }
 
-            const std::type_info &get_type() const
+            interned_name( interned_name &&other ) noexcept : held( other.held )
             {
-                return typeid(I);
+                other.held = NULL;
             }
 
-            const std::string &get_name() const
+            interned_name &operator=( interned_name other ) noexcept
             {
-                return name;
+                std::swap( held, other.held );
+                return *this;
+            }
+
+            ~interned_name()
+            {
+                if( held )
+                {
+                    name_table::release( held );
+                }
             }
 
-            void *create_item() const
+            const std::string *get() const
             {
-                return static_cast<void *>( internal_create_item() );
+                return held ? &held->text : NULL;
             }
     };
 
-    template<size_t index>
-        struct recursive_resolve_impl;
+    // The registrations a consumer's dependencies are bound to by
+    // contextual binding rules. A dependency type bound to a name is
+    // resolved from that named registration rather than the unnamed.
+    class dependency_bindings
+    {
+        private:
+            std::vector<std::pair<std::type_index, interned_name>> bindings;
 
-    template<>
-        struct recursive_resolve_impl<0>
-        {
-            template<typename resolver_type, typename t, typename callable_type>
-                static t *resolve(resolver_type &resolver, callable_type callable)
+        public:
+            // Bind a type to a name, replacing any earlier binding of
+            // the type
+            void bind( const std::type_info &type, const interned_name &name )
+            {
+                for( size_t i = 0; i < bindings.size(); ++i )
                 {
-                    return callable();
-                }
-        };
-
-    template<size_t i>
-        struct recursive_resolve_impl
-        {
-            template<typename resolver_type, typename t, 
-                typename callable_type, typename ...argtypes>
-                    static t *resolve(resolver_type &resolver, callable_type callable)
+                    if( bindings[i].first == type )
                     {
-                        return callable(resolver.template resolve<argtypes>()...);
+                        bindings[i].second = name;
+                        return;
                     }
-        };
+                }
+                bindings.push_back( std::make_pair( std::type_index( type ), name ) );
+            }
 
-    struct recursive_resolve
-    {
-        template<typename t, typename resolver_type, 
-            typename callable_type, typename ...argtypes>
-                static t *resolve(resolver_type &resolver, callable_type callable)
+            // The name a type is bound to or NULL
+            const std::string *find( const std::type_info &type ) const
+            {
+                for( size_t i = 0; i < bindings.size(); ++i )
                 {
-                    return recursive_resolve_impl<sizeof...(argtypes)>
-                        ::template resolve<resolver_type, t, callable_type, argtypes...>(resolver, callable);
+                    if( bindings[i].first == type )
+                    {
+                        return bindings[i].second.get();
+                    }
                 }
+                return NULL;
+            }
     };
 
-    // DelegateFactory allows delegate objects or routines to be
-    // supplied and called for object construction. All delegate
-    // arguments are resolved by the resolver before being send
-    // to the delegate instance.
-    template<typename I, typename callable, typename ...argtypes>
-        class delegate_factory : public base_factory<I>
+    // item_block owns a shared item through a control block that is
+    // the same for every item type, so a registered type only adds the
+    // code constructing and destroying its items. An allocated block
+    // and its item are a single allocation, placed in the current
+    // graph_arena if there is one.
+    class item_block
     {
+        public:
+            typedef void (*destroy_function)( void * );
+
         private:
-            ioc::container &container_obj;
-            callable callable_obj;
+            void *item;
+            destroy_function destroy;
 
-            I *internal_create_item() const
+            item_block( const item_block & );
+            item_block &operator=( const item_block & );
+
+        public:
+            item_block() : item( NULL ), destroy( NULL )
             {
-                // Resolve all variables for construction.
-                // If there is an error during resolution
-                // then the Resolver will de-allocate any
-                // already resolved objects for us.
+            }
 
-                //auto args =
-                //    tuple_resolve::
-                //        resolve<ioc::container, argtypes...>( container_obj );
-                //I *result = tuple_unwrap::call( callable_obj, args );
-                I *result = recursive_resolve
-                    ::resolve<I, ioc::container, callable, argtypes...>(container_obj, callable_obj);
-                return result;
+            ~item_block()
+            {
+                if( destroy )
+                {
+                    destroy( item );
+                }
             }
 
-        public:
-            delegate_factory( const std::string &name_in, 
-                    ioc::container &container_in, const 
-                    callable &callable_obj_in )
-                : base_factory<I>( name_in ), container_obj( container_in ), 
-                callable_obj( callable_obj_in )
-        {
-        }
+            // A block with 'storage' for an item of 'size' bytes aligned
+            // to 'alignment', which may exceed std::max_align_t
+            static std::shared_ptr<item_block> allocate( size_t size,
+                    size_t alignment, void *&storage );
 
-            ~delegate_factory()
+            // Hand the item constructed in the block's storage to the
+            // block, which destroys it with the last reference
+            void own( void *item_in, destroy_function destroy_in )
             {
+                item = item_in;
+                destroy = destroy_in;
             }
 
+            // Share the item handed to a block as 'result', which may
+            // point to a base of the item
+            static std::shared_ptr<void> share( 
+                    const std::shared_ptr<item_block> &block, void *result );
+
+            // Share an item allocated on its own, released with 'destroy'
+            static std::shared_ptr<void> adopt( void *item_in, 
+                    destroy_function destroy_in );
+
+            template<typename T>
+                static void destroy_item( void *item_in )
+                {
+                    static_cast<T *>( item_in )->~T();
+                }
+
+            template<typename T>
+                static void delete_item( void *item_in )
+                {
+                    delete static_cast<T *>( item_in );
+                }
     };
 
-    // ResolvableFactory extends DelegateFactory by supplying
-    // a standard function which can be used to instantiate
-    // and return an instance of a specific type.
-    template<typename I, typename T, typename ...argtypes>
-        class resolvable_factory 
-        : public delegate_factory<I, I* (*)( std::shared_ptr<argtypes>...), 
-        argtypes...>
+    // ifactory is the base interface for a factory 
+    // type. CreateItem returns a void * which can
+    // then be reinterpret_cast'd to the required type.
+    class ifactory 
     {
         private:
-            static I *creator(std::shared_ptr<argtypes>... args)
+            interned_name name;
+            // Bytes the graph beneath the factory needed when it was
+            // last resolved with graph allocation. Copies measure again.
+            mutable std::atomic<size_t> graph_size;
+
+        public:
+            explicit ifactory( const interned_name &name_in ) 
+                : name( name_in ), graph_size( 0 )
             {
-                return new T(args...);
             }
-        public:
-            typedef I *(func_type)(std::shared_ptr<argtypes>...);
 
-            resolvable_factory( 
-                    const std::string &name_in, 
-                    ioc::container &container_in )
-                : delegate_factory<I, I *(*)(std::shared_ptr<argtypes>...), argtypes...>
-                  ( name_in, container_in, resolvable_factory::creator )
-        {
-        }
+            ifactory( const ifactory &other ) 
+                : name( other.name ), graph_size( 0 )
+            {
+            }
 
-            ~resolvable_factory()
+            ifactory &operator=( const ifactory & )
             {
+                return *this;
             }
-    };
 
-    // isntance_factory stores an instance of the required type.
-    // create_item simply returns the stored instance.
-    // It should be noted that there is no guard around the instance
-    // to stop it being deleted by some other object once it has
-    // been resolved.
-    template<typename I>
-        class instance_factory
-        : public base_factory<I>
-        {
-            private: 
-                std::shared_ptr<I> instance;
+            virtual ~ifactory(){}
 
-                I *internal_create_item() const
-                {
-                    return instance.get();
-                }
+            // Share a factory through a control block that is the same
+            // for every factory type
+            static std::shared_ptr<ifactory> share( ifactory *factory );
 
-            public:
-                instance_factory( const std::string &name_in, std::shared_ptr<I> instance_in )
-                    : base_factory<I>( name_in ), instance( instance_in )
-                {
-                }
+            // The arena capacity to start the next graph with
+            size_t measured_graph() const
+            {
+                return graph_size.load( std::memory_order_relaxed );
+            }
 
-                ~instance_factory()
+            // Record the bytes a graph needed, keeping the largest
+            void measure_graph( size_t required ) const
+            {
+                size_t measured = graph_size.load( std::memory_order_relaxed );
+                while( required > measured && 
+                        !graph_size.compare_exchange_weak( measured, required,
+                            std::memory_order_relaxed ) )
                 {
                 }
-        };
+            }
 
-    // Registration exception classes
-    class registration_exception : public std::exception
-    {
-        private:
-            std::string type_name;
-            std::string registration_name;
-            std::string error;
-        public:
-            registration_exception( const std::string &type_name_in, 
-                    const std::string &registration_name_in )
-                : std::exception(), type_name( type_name_in ), 
-                registration_name( registration_name_in )
-        {
-            error = std::string( "Previous registration of type (Type: " ) +
-                    type_name + std::string( " , " ) + registration_name + 
-                    std::string( ")" );
-        }
+            const std::string &get_name() const
+            {
+                return *name.get();
+            }
 
-            ~registration_exception() throw()
+            const interned_name &get_interned_name() const
             {
+                return name;
             }
 
-            const std::string &get_type_name() const
+            virtual const std::type_info &get_type() const = 0;
+            virtual void* create_item( const container &resolver ) const = 0;
+            // Shared item of the type returned by get_type
+            virtual std::shared_ptr<void> create_any( const container &resolver ) const = 0;
+
+            // Shared item for a resolve-time key. Only factories which
+            // cache their items make use of the key.
+            virtual std::shared_ptr<void> create_keyed_any( const container &resolver,
+                    const std::string & ) const
             {
-                return type_name;
+                return create_any( resolver );
             }
 
-            const std::string &get_registration_name() const
+            // True if created items remain owned by the factory
+            virtual bool shares_items() const
             {
-                return registration_name;
+                return false;
             }
 
-            const char *what() const throw()
+            // An item owned by the caller, or NULL if the factory shares
+            // its items
+            void *create_owned( const container &resolver ) const
             {
-                return error.c_str(); 
+                return shares_items() ? NULL : create_item( resolver );
+            }
+
+            // True if every resolve hands out the same item, so that it
+            // may be cached by resolving threads or borrowed by reference
+            virtual bool repeats_items() const
+            {
+                return shares_items();
+            }
+
+            // Bytes used by the factory object itself
+            virtual size_t footprint() const = 0;
+            // The factory whose items a decorated factory wraps
+            virtual const ifactory *undecorated() const
+            {
+                return this;
+            }
+            // A copy of the factory resolving its dependencies as the
+            // bindings say, or NULL if the factory has no dependencies
+            // it can bind
+            virtual std::shared_ptr<ifactory> bind_dependencies(
+                    const std::shared_ptr<const dependency_bindings> & ) const
+            {
+                return std::shared_ptr<ifactory>();
             }
     };
 
-    // Container. All object types are registered with the container
-    // at run-time and can then be resolved. Resolver supports
-    // constructor injection.
-    class container
+    // Own a new factory. Factories sharing themselves need a control
+    // block of their own type, all others share the ifactory one.
+    template<typename F>
+        typename std::enable_if<
+            !std::is_base_of<std::enable_shared_from_this<F>, F>::value,
+            std::shared_ptr<ifactory>>::type own_factory( F *factory )
+        {
+            return ifactory::share( factory );
+        }
+
+    template<typename F>
+        typename std::enable_if<
+            std::is_base_of<std::enable_shared_from_this<F>, F>::value,
+            std::shared_ptr<ifactory>>::type own_factory( F *factory )
+        {
+            return std::shared_ptr<F>( factory );
+        }
+
+    // BaseFatory extends ifactory to provide some standard
+    // functionality that is required by most concrete
+    // factoy types. Items are handed out either shared or
+    // uniquely owned. Factories which keep hold of the items
+    // they create, such as instance_factory, report that they
+    // share them and cannot hand out unique ownership.
+    template<typename I>
+        class base_factory : public ifactory
     {
         private:
-            template<typename T>
-            struct ellided_deleter
+            virtual I *internal_create_item( const container &resolver ) const = 0;
+
+        public:
+
+            base_factory( const std::string &name_in ) 
+                : ifactory( interned_name( name_in ) )
             {
-                void operator()(T *val)
-                {
-                    // Shhhhh, don't actually delete the ptr.
-                }
-            };
-            typedef ellided_deleter<container> container_deleter;
-            
-            // Internal map of registered types -> map of named instances of
-            // type factories.
-            typedef std::map<std::string, ifactory*> named_factory;
-            typedef std::map<std::type_index, named_factory> registration_types;
+            }
 
-            registration_types types;
+            ~base_factory()
+            {
+            }
 
-            std::shared_ptr<container> self;
+            const std::type_info &get_type() const
+            {
+                return typeid(I);
+            }
 
-            static inline void destroy_factory( ifactory *factory )
+            void *create_item( const container &resolver ) const
             {
-                if( factory )
-                {
-                    delete factory;
-                    factory = NULL;
-                }
+                return static_cast<void *>( internal_create_item( resolver ) );
             }
 
-            // Registration helper
-            template<typename F, typename I, typename ...argtypes>
-                void register_with_name_template( const std::string &name_in,
-                        argtypes... args )
-                {
-                    if( type_is_registered<I>( name_in ) )
-                    {
-                        // Throw an exception as we cannot register a type
-                        // which has already been registered
-                        throw registration_exception( typeid(I).name(), 
-                                name_in );
-                    }
-                    F *new_factory = new F( name_in, args... );
-                    types[std::type_index(typeid(I))][name_in] = new_factory;
-                }
-            
-            // Resolve factory for interface. If that fails then return NULL.
-            template<typename I>
-                const ifactory *resolve_factory() const
+            // Items are shared through an item_block unless the factory
+            // shares them some other way
+            std::shared_ptr<void> create_any( const container &resolver ) const
+            {
+                I *item = internal_create_item( resolver );
+                if( !item )
                 {
-                    // Lookup interface type. If it cannot be found return
-                    // the default for that type.
-                    ifactory *result = NULL;
-                    registration_types::const_iterator i = types.find(std::type_index(typeid(I)));
-                    if( i != types.end() )
-                    {
-                        const named_factory candidates =
-                            i->second;
-                        result = (candidates.begin())->second;
-                    }
-                    return result;
+                    return std::shared_ptr<void>();
                 }
+                return item_block::adopt( item, &item_block::delete_item<I> );
+            }
 
-            // Resolve factory for interface type by name. 
-            // If that fails then return NULL.
-            template<typename I>
-                ifactory *
-                resolve_factory_by_name( const std::string &name_in ) const
-                {
-                    // Lookup interface type. If it cannot be found return
-                    // the default for that type.
-                    ifactory *result = NULL;
-                    registration_types::const_iterator i = types.find(std::type_index(typeid(I)));
-                    if( i != types.end() )
-                    {
-                        // We've got the type registered but we now need to look
-                        // up the named version.
-                        const named_factory::const_iterator c = 
-                            i->second.find(name_in);
-                        if( c != i->second.end() )
-                        {
-                            result = c->second;
-                        }
-                    }
-                    return result;
-                }
-            
-            
+            std::shared_ptr<I> create_shared( const container &resolver ) const
+            {
+                return std::static_pointer_cast<I>( create_any( resolver ) );
+            }
 
-        public:
-            container() : self(this, container_deleter())
+            std::shared_ptr<I> create_keyed( const container &resolver,
+                    const std::string &key ) const
             {
-                // Register our special shared_ptr which will not
-                // delete if a container is resolved.
-                this->register_instance<container>(self);
+                return std::static_pointer_cast<I>( create_keyed_any( resolver, key ) );
             }
 
-            ~container()
+            // Returns NULL if the factory shares its items
+            std::unique_ptr<I> create_unique( const container &resolver ) const
             {
-                // Destroy all factories
-                for( registration_types::reverse_iterator i = types.rbegin();
-                        i != types.rend(); ++i )
+                return std::unique_ptr<I>( static_cast<I *>( create_owned( resolver ) ) );
+            }
+    };
+
+    // dependency describes how a constructor or delegate argument
+    // is obtained from the resolver. By default an argument type A
+    // is resolved and passed as a std::shared_ptr<A>.
+    template<typename A>
+        struct dependency
+        {
+            typedef std::shared_ptr<A> type;
+
+            template<typename resolver_type>
+                static type resolve( resolver_type &resolver )
                 {
-                    for(named_factory::reverse_iterator j = i->second.rbegin(); 
-                            j != i->second.rend(); ++j)
-                    {
-                        destroy_factory( j->second );
-                    }
-                    i->second.clear();
+                    return resolver.template resolve<A>();
                 }
+        };
 
-                types.clear();
-            }
+    // Arguments may also be requested by their owning pointer or
+    // by reference. A std::unique_ptr<A> argument receives a newly
+    // created A with sole ownership, an A& argument receives a
+    // reference to a shared item such as a registered instance.
+    template<typename A>
+        struct dependency<std::shared_ptr<A>> : dependency<A>
+        {
+        };
 
-            // Check if a factory to create a gievn interface
-            // already exists
-            template<typename I>
-                bool type_is_registered( const std::string &name_in ) const
+    template<typename A>
+        struct dependency<std::unique_ptr<A>>
+        {
+            typedef std::unique_ptr<A> type;
+
+            template<typename resolver_type>
+                static type resolve( resolver_type &resolver )
                 {
-                    const ifactory *f = resolve_factory_by_name<I>( name_in );    
-                    return f ? true : false;
+                    return resolver.template resolve_unique<A>();
                 }
+        };
 
-            template<typename I>
-                bool type_is_registered() const
+    template<typename A>
+        struct dependency<A &>
+        {
+            typedef A &type;
+
+            template<typename resolver_type>
+                static type resolve( resolver_type &resolver )
                 {
-                    const ifactory *f = resolve_factory<I>();    
-                    return f ? true : false;
+                    return resolver.template resolve_reference<A>();
                 }
+        };
 
+    // Argument tag requesting an A passed by value. The A is
+    // created uniquely owned and moved into the argument.
+    template<typename A>
+        struct by_value
+        {
+        };
 
+    template<typename A>
+        struct dependency<by_value<A>>
+        {
+            typedef A type;
 
-            template<typename I, typename callable, typename ...argtypes>
-                void register_delegate_with_name( const std::string &name_in,
-                        callable call_obj )
+            template<typename resolver_type>
+                static type resolve( resolver_type &resolver )
+                {
+                    return resolver.template resolve_value<A>();
+                }
+        };
+
+    // Argument tag requesting a value passed to the resolve call
+    // rather than an injected item. An A& argument refers to the value
+    // passed, an A argument receives a copy of it.
+    template<typename A>
+        struct argument
+        {
+        };
+
+    // The arguments of the resolve calls in progress on the calling
+    // thread. Each call's arguments are visible to every item of the
+    // graph it resolves, innermost call first, and are matched by type.
+    class runtime_arguments
+    {
+        public:
+            struct value
+            {
+                const std::type_info *type;
+                void *item;
+                bool writable;
+
+                template<typename A>
+                    explicit value( A &item_in )
+                    : type( &typeid(A) ), 
+                    item( const_cast<void *>( static_cast<const void *>( &item_in ) ) ),
+                    writable( !std::is_const<A>::value )
+                    {
+                    }
+            };
+
+        private:
+            const value *values;
+            size_t count;
+            runtime_arguments *previous;
+
+            runtime_arguments( const runtime_arguments & );
+            runtime_arguments &operator=( const runtime_arguments & );
+
+            static runtime_arguments *&current()
+            {
+                static thread_local runtime_arguments *frame = NULL;
+                return frame;
+            }
+
+            static const value *find( const std::type_info &type );
+
+            // Throws a resolution_exception for a missing argument
+            [[noreturn]] static void missing( const std::type_info &type );
+
+        public:
+            runtime_arguments( const value *values_in, size_t count_in )
+                : values( values_in ), count( count_in ), previous( current() )
+            {
+                current() = this;
+            }
+
+            ~runtime_arguments()
+            {
+                current() = previous;
+            }
+
+            // The argument of type A, which must be writable if 'writable'
+            template<typename A>
+                static A &get( bool writable )
+                {
+                    const value *found = find( typeid(A) );
+                    if( !found || ( writable && !found->writable ) )
+                    {
+                        missing( typeid(A) );
+                    }
+                    return *static_cast<A *>( found->item );
+                }
+    };
+
+    template<typename A>
+        struct dependency<argument<A>>
+        {
+            typedef A type;
+
+            template<typename resolver_type>
+                static type resolve( resolver_type & )
+                {
+                    typedef typename std::remove_reference<A>::type stored;
+                    return runtime_arguments::get<stored>( std::is_reference<A>::value &&
+                            !std::is_const<stored>::value );
+                }
+        };
+
+    // A list of argument types. Types may declare the arguments
+    // their constructor requires with a nested typedef named inject
+    // e.g. typedef ioc::dependencies<foo, bar> inject;
+    template<typename ...argtypes>
+        struct dependencies
+        {
+            typedef dependencies type;
+        };
+
+    // any_dependency stands in for a constructor argument whose type
+    // has been left for the compiler to deduce. It converts to
+    // whichever std::shared_ptr or std::unique_ptr the constructor
+    // asks for by resolving it, at the same cost as a declared
+    // argument. References and values must be declared. Contextual
+    // bindings of a deduced argument can only be looked up once its
+    // type is known.
+    template<typename resolver_type>
+        class any_dependency
+        {
+            private:
+                resolver_type &resolver;
+                const dependency_bindings *bindings;
+
+            public:
+                any_dependency( resolver_type &resolver_in,
+                        const dependency_bindings *bindings_in = NULL )
+                    : resolver( resolver_in ), bindings( bindings_in )
+                {
+                }
+
+                template<typename U>
+                    operator std::shared_ptr<U>() const
+                    {
+                        typedef typename std::remove_const<U>::type A;
+                        const std::string *name = 
+                            bindings ? bindings->find( typeid(A) ) : NULL;
+                        return name ? resolver.template resolve_by_name<A>( *name )
+                            : resolver.template resolve<A>();
+                    }
+
+                template<typename U>
+                    operator std::unique_ptr<U>() const
+                    {
+                        const std::string *name = 
+                            bindings ? bindings->find( typeid(U) ) : NULL;
+                        return name ? resolver.template resolve_unique_by_name<U>( *name )
+                            : resolver.template resolve_unique<U>();
+                    }
+        };
+
+    // Argument tag used in place of each deduced argument.
+    struct deduced_argument;
+
+    template<>
+        struct dependency<deduced_argument>
+        {
+            typedef any_dependency<const container> type;
+
+            template<typename resolver_type>
+                static type resolve( resolver_type &resolver )
+                {
+                    return type( resolver );
+                }
+        };
+
+    // contextual_dependency resolves an argument of a factory bound by
+    // contextual binding rules. The name the argument's type is bound
+    // to is looked up when the factory is bound and given here, NULL
+    // resolves the unnamed registration as dependency would.
+    template<typename A>
+        struct contextual_dependency
+        {
+            // The type looked up in the bindings
+            static const std::type_info *bound_type()
+            {
+                return &typeid(A);
+            }
+
+            template<typename resolver_type>
+                static typename dependency<A>::type resolve( resolver_type &resolver,
+                        const std::string *name, const dependency_bindings * )
+                {
+                    return name ? resolver.template resolve_by_name<A>( *name )
+                        : resolver.template resolve<A>();
+                }
+        };
+
+    template<typename A>
+        struct contextual_dependency<std::shared_ptr<A>> : contextual_dependency<A>
+        {
+        };
+
+    template<typename A>
+        struct contextual_dependency<std::unique_ptr<A>>
+        {
+            static const std::type_info *bound_type()
+            {
+                return &typeid(A);
+            }
+
+            template<typename resolver_type>
+                static std::unique_ptr<A> resolve( resolver_type &resolver,
+                        const std::string *name, const dependency_bindings * )
+                {
+                    return name ? resolver.template resolve_unique_by_name<A>( *name )
+                        : resolver.template resolve_unique<A>();
+                }
+        };
+
+    template<typename A>
+        struct contextual_dependency<A &>
+        {
+            static const std::type_info *bound_type()
+            {
+                return &typeid(A);
+            }
+
+            template<typename resolver_type>
+                static A &resolve( resolver_type &resolver,
+                        const std::string *name, const dependency_bindings * )
+                {
+                    return name ? resolver.template resolve_reference_by_name<A>( *name )
+                        : resolver.template resolve_reference<A>();
+                }
+        };
+
+    template<typename A>
+        struct contextual_dependency<by_value<A>>
+        {
+            static const std::type_info *bound_type()
+            {
+                return &typeid(A);
+            }
+
+            template<typename resolver_type>
+                static A resolve( resolver_type &resolver,
+                        const std::string *name, const dependency_bindings * )
+                {
+                    return name ? resolver.template resolve_value_by_name<A>( *name )
+                        : resolver.template resolve_value<A>();
+                }
+        };
+
+    // Runtime arguments are never bound
+    template<typename A>
+        struct contextual_dependency<argument<A>>
+        {
+            static const std::type_info *bound_type()
+            {
+                return NULL;
+            }
+
+            template<typename resolver_type>
+                static A resolve( resolver_type &resolver,
+                        const std::string *, const dependency_bindings * )
+                {
+                    return dependency<argument<A>>::resolve( resolver );
+                }
+        };
+
+    // A deduced argument's type is only known once it is converted
+    // so it looks its binding up then.
+    template<>
+        struct contextual_dependency<deduced_argument>
+        {
+            static const std::type_info *bound_type()
+            {
+                return NULL;
+            }
+
+            template<typename resolver_type>
+                static any_dependency<const container> resolve( resolver_type &resolver,
+                        const std::string *, const dependency_bindings *bindings )
+                {
+                    return any_dependency<const container>( resolver, bindings );
+                }
+        };
+
+    // Maximum number of constructor arguments tried when deducing
+    // a constructor signature.
+#ifndef IOC_MAX_DEDUCED_ARGUMENTS
+#define IOC_MAX_DEDUCED_ARGUMENTS 10
+#endif
+
+    // Produce a list of n deduced arguments.
+    template<size_t n, typename list = dependencies<>>
+        struct deduced_arguments;
+
+    template<typename ...argtypes>
+        struct deduced_arguments<0, dependencies<argtypes...>>
+        {
+            typedef dependencies<argtypes...> type;
+        };
+
+    template<size_t n, typename ...argtypes>
+        struct deduced_arguments<n, dependencies<argtypes...>>
+        : deduced_arguments<n - 1, dependencies<deduced_argument, argtypes...>>
+        {
+        };
+
+    template<typename T, typename list>
+        struct is_constructible_from;
+
+    template<typename T, typename ...argtypes>
+        struct is_constructible_from<T, dependencies<argtypes...>>
+        : std::is_constructible<T, typename dependency<argtypes>::type...>
+        {
+        };
+
+    // Find the smallest number of arguments T can be constructed
+    // from. The smallest is chosen so that a default constructible
+    // type is default constructed as it always has been.
+    template<typename T, size_t n = 0, bool found = 
+        is_constructible_from<T, typename deduced_arguments<n>::type>::value>
+        struct deduced_arity;
+
+    template<typename T, size_t n>
+        struct deduced_arity<T, n, true>
+        {
+            static const size_t value = n;
+        };
+
+    template<typename T, size_t n>
+        struct deduced_arity<T, n, false>
+        : deduced_arity<T, n + 1>
+        {
+        };
+
+    template<typename T>
+        struct deduced_arity<T, IOC_MAX_DEDUCED_ARGUMENTS + 1, false>
+        {
+            static_assert( sizeof(T) == 0, "Unable to deduce a constructor "
+                    "signature, declare typedef ioc::dependencies<...> inject" );
+        };
+
+    template<typename T>
+        struct has_inject_typedef
+        {
+            private:
+                template<typename U>
+                    static char test( typename U::inject * );
+                template<typename U>
+                    static long test( ... );
+
+            public:
+                static const bool value = sizeof(test<T>(0)) == sizeof(char);
+        };
+
+    template<typename T, bool declared = has_inject_typedef<T>::value>
+        struct deduced_dependencies
+        {
+            typedef typename T::inject type;
+        };
+
+    // Use the nested inject typedef if T declares one otherwise
+    // deduce the arguments from T's constructors.
+    template<typename T>
+        struct deduced_dependencies<T, false>
+        : deduced_arguments<deduced_arity<T>::value>
+        {
+        };
+
+    // A list of argument indices, used to pair each argument of a
+    // factory with its contextual binding.
+    template<size_t ...indices>
+        struct argument_indices
+        {
+        };
+
+    template<size_t n, size_t ...indices>
+        struct make_argument_indices
+        : make_argument_indices<n - 1, n - 1, indices...>
+        {
+        };
+
+    template<size_t ...indices>
+        struct make_argument_indices<0, indices...>
+        {
+            typedef argument_indices<indices...> type;
+        };
+
+    // The indices of a list of arguments
+    template<typename list>
+        struct indices_of;
+
+    template<typename ...argtypes>
+        struct indices_of<dependencies<argtypes...>>
+        : make_argument_indices<sizeof...(argtypes)>
+        {
+        };
+
+    // graph_arena is a single block of memory holding a graph of
+    // transient items together with their control blocks. Items are
+    // placed in construction order and the block is released once
+    // every item placed in it has been destroyed. Allocations which do
+    // not fit are taken from the heap, the arena records the size the
+    // graph needed so the next block can be sized to fit.
+    class graph_arena
+    {
+        private:
+            char *block;
+            size_t capacity;
+            size_t cursor;
+            std::atomic<size_t> references;
+
+            graph_arena( char *block_in, size_t capacity_in )
+                : block( block_in ), capacity( capacity_in ), cursor( 0 ), 
+                references( 1 )
+            {
+            }
+
+            static size_t header_size()
+            {
+                const size_t alignment = alignof(std::max_align_t);
+                return ( sizeof(graph_arena) + alignment - 1 ) & ~( alignment - 1 );
+            }
+
+            bool owns( const void *p ) const
+            {
+                const std::less<const void *> before = std::less<const void *>();
+                return !before( p, block ) && before( p, block + capacity );
+            }
+
+        public:
+            // The arena and its block are a single allocation. The
+            // caller holds the first reference.
+            static graph_arena *create( size_t capacity_in )
+            {
+                char *raw = static_cast<char *>( 
+                        ::operator new( header_size() + capacity_in ) );
+                return new( raw ) graph_arena( raw + header_size(), capacity_in );
+            }
+
+            // Allocation only happens on the constructing thread, items
+            // may be released from any thread. Alignments beyond
+            // std::max_align_t are not supported.
+            void *allocate( size_t size, size_t alignment )
+            {
+                const size_t offset = ( cursor + alignment - 1 ) & ~( alignment - 1 );
+                cursor = offset + size;
+                references.fetch_add( 1, std::memory_order_relaxed );
+                if( cursor <= capacity )
+                {
+                    return block + offset;
+                }
+                return ::operator new( size );
+            }
+
+            void deallocate( void *p )
+            {
+                if( !owns( p ) )
+                {
+                    ::operator delete( p );
+                }
+                release();
+            }
+
+            void release()
+            {
+                if( references.fetch_sub( 1, std::memory_order_acq_rel ) == 1 )
+                {
+                    this->~graph_arena();
+                    ::operator delete( static_cast<void *>( this ) );
+                }
+            }
+
+            // Bytes needed to hold everything allocated so far
+            size_t required() const
+            {
+                return cursor;
+            }
+
+            // The arena items created on this thread are placed in
+            static graph_arena *&current()
+            {
+                static thread_local graph_arena *arena = NULL;
+                return arena;
+            }
+    };
+
+    // Place items created on this thread in an arena, or in none,
+    // for the lifetime of the scope.
+    class graph_scope
+    {
+        private:
+            graph_arena *previous;
+
+            graph_scope( const graph_scope & );
+            graph_scope &operator=( const graph_scope & );
+
+        public:
+            explicit graph_scope( graph_arena *arena )
+                : previous( graph_arena::current() )
+            {
+                graph_arena::current() = arena;
+            }
+
+            ~graph_scope()
+            {
+                graph_arena::current() = previous;
+            }
+    };
+
+    // The arguments a type is registered with. Without any explicit
+    // arguments the constructor signature of T is deduced.
+    template<typename T, typename ...argtypes>
+        struct registration_arguments
+        : std::conditional<sizeof...(argtypes) == 0,
+        deduced_dependencies<T>, dependencies<argtypes...> >::type
+        {
+        };
+
+    // The names the arguments of a factory bound by contextual binding
+    // rules are resolved from. Slot i holds the name argument i is
+    // bound to, or NULL to resolve the unnamed registration.
+    struct bound_arguments
+    {
+        std::shared_ptr<const dependency_bindings> bindings;
+        std::unique_ptr<const std::string *[]> slots;
+
+        // The name argument 'index' is bound to, NULL when unbound
+        static const std::string *name( const bound_arguments *bound, size_t index )
+        {
+            return bound ? bound->slots[index] : NULL;
+        }
+
+        static const dependency_bindings *rules( const bound_arguments *bound )
+        {
+            return bound ? bound->bindings.get() : NULL;
+        }
+    };
+
+    // construction is how a registration builds its items and is all
+    // the code a registered type adds. The factories using it, along
+    // with binding and graph allocation, are the same for every type
+    // registered for an interface. The factory building is passed so
+    // a delegate can find its callable. An item built for sharing is
+    // handed back through 'shared', otherwise the caller owns it.
+    struct construction
+    {
+        // The interface built items are returned as
+        const std::type_info *type;
+        void *(*build)( const ifactory &factory, const container &resolver,
+                const bound_arguments *bound, std::shared_ptr<void> *shared );
+        // The type argument 'index' is looked up by in contextual
+        // bindings, NULL if it is never bound
+        const std::type_info *(*bound_type)( size_t index );
+        size_t arity;
+    };
+
+    // construction_plan builds the items of a factory from its
+    // construction, resolving arguments by name once it is bound.
+    class construction_plan
+    {
+        private:
+            const construction *recipe;
+            std::shared_ptr<const bound_arguments> bound;
+
+        public:
+            explicit construction_plan( const construction *recipe_in )
+                : recipe( recipe_in )
+            {
+            }
+
+            const std::type_info &type() const
+            {
+                return *recipe->type;
+            }
+
+            void *create( const ifactory &factory, const container &resolver ) const
+            {
+                return recipe->build( factory, resolver, bound.get(), NULL );
+            }
+
+            std::shared_ptr<void> create_shared( const ifactory &factory,
+                    const container &resolver ) const
+            {
+                std::shared_ptr<void> item;
+                recipe->build( factory, resolver, bound.get(), &item );
+                return item;
+            }
+
+            // Look up the name each argument is bound to. Names are
+            // looked up here so that a bound argument costs no more to
+            // resolve than another.
+            void bind( const std::shared_ptr<const dependency_bindings> &bindings );
+
+            // Bytes held for bound arguments
+            size_t footprint() const
+            {
+                return bound ? sizeof(bound_arguments) + 
+                    recipe->arity * sizeof(const std::string *) : 0;
+            }
+    };
+
+    // The types the arguments of a construction are bound by
+    template<typename ...argtypes>
+        struct contextual_arguments
+        {
+            static const std::type_info *bound_type( size_t index )
+            {
+                const std::type_info *types[] = 
+                { 
+                    contextual_dependency<argtypes>::bound_type()..., NULL 
+                };
+                return types[index];
+            }
+        };
+
+    // Shared items are constructed in an item_block, in the current
+    // arena if any, so T adds no control block of its own. Resolved
+    // arguments are moved into the constructor.
+    template<typename I, typename T>
+        struct item_constructor
+        {
+            template<typename ...resolved>
+                static void *construct( std::shared_ptr<void> *shared, 
+                        resolved &&...args )
+                {
+                    if( !shared )
+                    {
+                        return static_cast<I *>( new T( std::forward<resolved>( args )... ) );
+                    }
+                    void *storage = NULL;
+                    const std::shared_ptr<item_block> block = 
+                        item_block::allocate( sizeof(T), alignof(T), storage );
+                    T *item = new( storage ) T( std::forward<resolved>( args )... );
+                    block->own( item, &item_block::destroy_item<T> );
+                    I *result = item;
+                    *shared = item_block::share( block, result );
+                    return result;
+                }
+        };
+
+    // The construction of T for interface I from a list of arguments
+    template<typename I, typename T, typename list,
+        typename indices = typename indices_of<list>::type>
+        struct constructor;
+
+    template<typename I, typename T, typename ...argtypes, size_t ...indices>
+        struct constructor<I, T, dependencies<argtypes...>, argument_indices<indices...>>
+        {
+            static void *build( const ifactory &, const container &resolver,
+                    const bound_arguments *bound, std::shared_ptr<void> *shared )
+            {
+                return item_constructor<I, T>::construct( shared, 
+                        contextual_dependency<argtypes>::resolve( resolver,
+                            bound_arguments::name( bound, indices ),
+                            bound_arguments::rules( bound ) )... );
+            }
+
+            static const construction value;
+        };
+
+    template<typename I, typename T, typename ...argtypes, size_t ...indices>
+        const construction constructor<I, T, dependencies<argtypes...>, 
+              argument_indices<indices...>>::value =
+        {
+            &typeid(I), &constructor::build, 
+            &contextual_arguments<argtypes...>::bound_type, sizeof...(argtypes)
+        };
+
+    // The construction of T for interface I from the arguments it is
+    // registered with
+    template<typename I, typename T, typename ...argtypes>
+        const construction *construction_of()
+        {
+            return &constructor<I, T, 
+                   typename registration_arguments<T, argtypes...>::type>::value;
+        }
+
+    // ResolvableFactory creates the items of a registered type as its
+    // construction says. The factory itself is the same for every
+    // registered type, so registering a type adds only the code of its
+    // construction. The resolver is the container the item is being
+    // resolved from rather than the one the factory was registered
+    // with, so factories can be shared between a snapshot and the
+    // containers derived from it.
+    class resolvable_factory : public ifactory
+    {
+        private:
+            construction_plan plan;
+
+        protected:
+            const construction_plan &get_plan() const
+            {
+                return plan;
+            }
+
+        public:
+            resolvable_factory( const std::string &name_in, 
+                    const construction *recipe_in );
+
+            IOC_DECL const std::type_info &get_type() const;
+
+            IOC_DECL void *create_item( const container &resolver ) const;
+
+            IOC_DECL std::shared_ptr<void> create_any( const container &resolver ) const;
+
+            // Factories extending this one must return a copy of
+            // themselves so they can be bound
+            IOC_DECL virtual std::shared_ptr<ifactory> clone() const;
+
+            IOC_DECL std::shared_ptr<ifactory> bind_dependencies(
+                    const std::shared_ptr<const dependency_bindings> &bindings ) const;
+
+            IOC_DECL size_t footprint() const;
+    };
+
+    // The construction of a delegate's items, calling the delegate
+    // held by the factory building them
+    template<typename factory_type, typename I, typename list,
+        typename indices = typename indices_of<list>::type>
+        struct delegate_constructor;
+
+    template<typename factory_type, typename I, typename ...argtypes, 
+        size_t ...indices>
+        struct delegate_constructor<factory_type, I, dependencies<argtypes...>, 
+        argument_indices<indices...>>
+        {
+            static void *build( const ifactory &factory, const container &resolver,
+                    const bound_arguments *bound, std::shared_ptr<void> *shared )
+            {
+                typename factory_type::callable_type callable_obj = 
+                    static_cast<const factory_type &>( factory ).get_callable();
+                I *item = callable_obj( contextual_dependency<argtypes>::resolve( 
+                            resolver, bound_arguments::name( bound, indices ),
+                            bound_arguments::rules( bound ) )... );
+                if( shared && item )
+                {
+                    *shared = item_block::adopt( item, &item_block::delete_item<I> );
+                }
+                return item;
+            }
+
+            static const construction value;
+        };
+
+    template<typename factory_type, typename I, typename ...argtypes, 
+        size_t ...indices>
+        const construction delegate_constructor<factory_type, I, 
+              dependencies<argtypes...>, argument_indices<indices...>>::value =
+        {
+            &typeid(I), &delegate_constructor::build, 
+            &contextual_arguments<argtypes...>::bound_type, sizeof...(argtypes)
+        };
+
+    // DelegateFactory allows delegate objects or routines to be
+    // supplied and called for object construction. All delegate
+    // arguments are resolved by the resolver before being send
+    // to the delegate instance.
+    template<typename I, typename callable, typename ...argtypes>
+        class delegate_factory : public resolvable_factory
+    {
+        private:
+            typedef delegate_constructor<delegate_factory, I, 
+                    dependencies<argtypes...>> constructor_type;
+
+            callable callable_obj;
+
+        public:
+            typedef callable callable_type;
+
+            delegate_factory( const std::string &name_in, 
+                    const callable &callable_obj_in )
+                : resolvable_factory( name_in, &constructor_type::value ), 
+                callable_obj( callable_obj_in )
+        {
+        }
+
+            ~delegate_factory()
+            {
+            }
+
+            const callable &get_callable() const
+            {
+                return callable_obj;
+            }
+
+            std::shared_ptr<ifactory> clone() const
+            {
+                return ifactory::share( new delegate_factory( *this ) );
+            }
+
+            size_t footprint() const
+            {
+                return sizeof(*this) + this->get_plan().footprint();
+            }
+    };
+
+    // Tag naming an interface template, such as repository for every
+    // repository<T>
+    template<template<typename...> class F>
+        struct generic_family
+        {
+        };
+
+    // Found when no IOC_GENERIC_IMPLEMENTATION declaration matches.
+    // Only ever named in unevaluated expressions.
+    void ioc_generic_implementation( ... );
+
+    // The implementation type declared for I by the implementation
+    // template of its interface template, void if there is none.
+    template<typename I>
+        struct generic_implementation
+        {
+            typedef typename std::remove_pointer<decltype( 
+                    ioc_generic_implementation( static_cast<I *>( NULL ) ) )>::type type;
+        };
+
+    // The interface template I is an instance of, if any
+    template<typename I>
+        struct generic_instance
+        {
+            static const std::type_info *family()
+            {
+                return NULL;
+            }
+        };
+
+    template<template<typename...> class F, typename ...argtypes>
+        struct generic_instance<F<argtypes...>>
+        {
+            static const std::type_info *family()
+            {
+                return &typeid(generic_family<F>);
+            }
+        };
+
+    // isntance_factory stores an instance of the required type.
+    // create_item simply returns the stored instance and resolving
+    // shares ownership of it.
+    template<typename I>
+        class instance_factory
+        : public base_factory<I>
+        {
+            private: 
+                std::shared_ptr<I> instance;
+
+                I *internal_create_item( const container & ) const
+                {
+                    return instance.get();
+                }
+
+                bool shares_items() const
+                {
+                    return true;
+                }
+
+                std::shared_ptr<void> create_any( const container & ) const
+                {
+                    return instance;
+                }
+
+            public:
+                instance_factory( const std::string &name_in, std::shared_ptr<I> instance_in )
+                    : base_factory<I>( name_in ), instance( instance_in )
+                {
+                }
+
+                ~instance_factory()
+                {
+                }
+
+                // The instance itself belongs to the caller
+                size_t footprint() const
+                {
+                    return sizeof(*this);
+                }
+        };
+
+    // decorated_factory wraps each item created by another factory of
+    // the same interface in a chain of decorators, innermost first. The
+    // chain is fixed when the factory is built. Every resolve creates
+    // new decorators, even around items the inner factory shares.
+    template<typename I>
+        class decorated_factory : public base_factory<I>
+        {
+            public:
+                typedef I *(*decorator)( const std::shared_ptr<I> &inner,
+                        const container &resolver );
+                typedef std::vector<decorator> chain;
+
+            private:
+                std::shared_ptr<ifactory> inner;
+                std::shared_ptr<const chain> decorators;
+
+                I *internal_create_item( const container &resolver ) const
+                {
+                    std::shared_ptr<I> item = 
+                        std::static_pointer_cast<I>( inner->create_any( resolver ) );
+                    if( !item )
+                    {
+                        return NULL;
+                    }
+                    for( size_t i = 0; i + 1 < decorators->size(); ++i )
+                    {
+                        item.reset( (*decorators)[i]( item, resolver ) );
+                    }
+                    return decorators->back()( item, resolver );
+                }
+
+            public:
+                decorated_factory( const std::shared_ptr<ifactory> &inner_in,
+                        const std::shared_ptr<const chain> &decorators_in )
+                    : base_factory<I>( inner_in->get_name() ), inner( inner_in ),
+                    decorators( decorators_in )
+                {
+                }
+
+                const std::shared_ptr<ifactory> &get_inner() const
+                {
+                    return inner;
+                }
+
+                const ifactory *undecorated() const
+                {
+                    return inner.get();
+                }
+
+                // Bind the inner factory and wrap it in the same chain
+                std::shared_ptr<ifactory> bind_dependencies(
+                        const std::shared_ptr<const dependency_bindings> &bindings ) const
+                {
+                    std::shared_ptr<ifactory> bound = inner->bind_dependencies( bindings );
+                    if( !bound )
+                    {
+                        return bound;
+                    }
+                    return ifactory::share( new decorated_factory( bound, decorators ) );
+                }
+
+                // The chain is shared by every registration it decorates
+                size_t footprint() const
+                {
+                    return sizeof(*this) + inner->footprint();
+                }
+        };
+
+    // Registration exception classes
+    class registration_exception : public std::exception
+    {
+        private:
+            std::string type_name;
+            std::string registration_name;
+            std::string error;
+        public:
+            registration_exception( const std::string &type_name_in, 
+                    const std::string &registration_name_in )
+                : std::exception(), type_name( type_name_in ), 
+                registration_name( registration_name_in )
+        {
+            error = std::string( "Previous registration of type (Type: " ) +
+                    type_name + std::string( " , " ) + registration_name + 
+                    std::string( ")" );
+        }
+
+            ~registration_exception() throw()
+            {
+            }
+
+            const std::string &get_type_name() const
+            {
+                return type_name;
+            }
+
+            const std::string &get_registration_name() const
+            {
+                return registration_name;
+            }
+
+            const char *what() const throw()
+            {
+                return error.c_str(); 
+            }
+    };
+
+    // Resolution exception class. Thrown when an argument which
+    // cannot be NULL, such as a reference, cannot be resolved.
+    class resolution_exception : public std::exception
+    {
+        private:
+            std::string type_name;
+            std::string reason;
+            std::string error;
+        public:
+            resolution_exception( const std::string &type_name_in, 
+                    const std::string &reason_in )
+                : std::exception(), type_name( type_name_in ), 
+                reason( reason_in )
+        {
+            error = std::string( "Unable to resolve type (Type: " ) +
+                    type_name + std::string( " , " ) + reason + 
+                    std::string( ")" );
+        }
+
+            ~resolution_exception() throw()
+            {
+            }
+
+            const std::string &get_type_name() const
+            {
+                return type_name;
+            }
+
+            const std::string &get_reason() const
+            {
+                return reason;
+            }
+
+            const char *what() const throw()
+            {
+                return error.c_str(); 
+            }
+    };
+
+    // epoch_domain implements epoch based reclamation. Resolvers
+    // announce the epoch they entered in, retired objects are
+    // stamped with the epoch they were retired in and released only
+    // once every resolver active at that time has left.
+    template<typename unused>
+    class basic_epoch_domain
+    {
+        private:
+            struct thread_record
+            {
+                std::atomic<unsigned long long> active;
+                unsigned depth;
+                // Open retire_scopes on the thread
+                unsigned deferrals;
+
+                thread_record() : active( 0 ), depth( 0 ), deferrals( 0 )
+                {
+                }
+            };
+
+            // Registers the calling thread with the domain for the
+            // lifetime of the thread.
+            struct thread_registration
+            {
+                thread_record record;
+
+                thread_registration()
+                {
+                    basic_epoch_domain &domain = instance();
+                    std::lock_guard<std::mutex> guard( domain.lock );
+                    domain.records.push_back( &record );
+                }
+
+                ~thread_registration()
+                {
+                    basic_epoch_domain &domain = instance();
+                    std::lock_guard<std::mutex> guard( domain.lock );
+                    domain.records.erase( std::find( domain.records.begin(),
+                                domain.records.end(), &record ) );
+                }
+            };
+
+            typedef std::pair<unsigned long long, std::shared_ptr<void>> retired_item;
+
+            std::atomic<unsigned long long> epoch;
+            std::mutex lock;
+            std::vector<thread_record *> records;
+            std::vector<retired_item> retired;
+
+            basic_epoch_domain() : epoch( 1 )
+            {
+            }
+
+            static thread_record &local()
+            {
+                static thread_local thread_registration registration;
+                return registration.record;
+            }
+
+        public:
+            // The domain is never destroyed so that threads exiting
+            // after static destruction may still deregister.
+            static basic_epoch_domain &instance()
+            {
+                static basic_epoch_domain *domain = new basic_epoch_domain();
+                return *domain;
+            }
+
+            static void enter()
+            {
+                thread_record &record = local();
+                if( record.depth++ == 0 )
+                {
+                    record.active.store( instance().epoch.load(), 
+                            std::memory_order_seq_cst );
+                }
+            }
+
+            static void leave()
+            {
+                thread_record &record = local();
+                if( --record.depth == 0 )
+                {
+                    record.active.store( 0, std::memory_order_release );
+                }
+            }
+
+            static void defer()
+            {
+                ++local().deferrals;
+            }
+
+            static void resume()
+            {
+                if( --local().deferrals == 0 )
+                {
+                    instance().collect();
+                }
+            }
+
+            // Hand over an object which has been unpublished. It is
+            // released once no resolver can still be using it, but
+            // never before the calling thread's retire_scopes end.
+            void retire( const std::shared_ptr<void> &item );
+
+            // Release every retired object no resolver can reference
+            void collect();
+    };
+    typedef basic_epoch_domain<void> epoch_domain;
+
+    // Resolvers hold an epoch_guard while they may dereference a
+    // factory which could be replaced concurrently.
+    template<typename unused>
+    class basic_epoch_guard
+    {
+        public:
+            basic_epoch_guard()
+            {
+                basic_epoch_domain<unused>::enter();
+            }
+
+            ~basic_epoch_guard()
+            {
+                basic_epoch_domain<unused>::leave();
+            }
+
+        private:
+            basic_epoch_guard( const basic_epoch_guard & );
+            basic_epoch_guard &operator=( const basic_epoch_guard & );
+    };
+    typedef basic_epoch_guard<void> epoch_guard;
+
+    // Code retiring objects while holding locks opens a retire_scope
+    // before taking them. Retired objects, whose destructors may be
+    // user code, are then collected once the outermost scope ends
+    // and the locks have been released.
+    template<typename unused>
+    class basic_retire_scope
+    {
+        public:
+            basic_retire_scope()
+            {
+                basic_epoch_domain<unused>::defer();
+            }
+
+            ~basic_retire_scope()
+            {
+                basic_epoch_domain<unused>::resume();
+            }
+
+        private:
+            basic_retire_scope( const basic_retire_scope & );
+            basic_retire_scope &operator=( const basic_retire_scope & );
+    };
+    typedef basic_retire_scope<void> retire_scope;
+
+    // Dense ids for types resolved by runtime dispatch. A type is given
+    // the next id the first time it is seen and keeps it for the life
+    // of the process, so dispatch tables are indexed by it.
+    template<typename unused>
+    class basic_type_ids
+    {
+        private:
+            struct storage;
+            static storage &instance();
+
+        public:
+            // The id of a type, giving it one if it has none
+            static size_t of( const std::type_index &type );
+
+            // Look up the id of a type without giving it one. The caller
+            // must hold an epoch_guard.
+            static bool find( const std::type_index &type, size_t &id );
+
+            template<typename I>
+                static size_t of()
+                {
+                    static const size_t id = of( std::type_index( typeid(I) ) );
+                    return id;
+                }
+    };
+    typedef basic_type_ids<void> type_ids;
+
+    // reclamation_queue destroys items away from the threads releasing
+    // them. Releasing threads push onto a lock-free list, a single
+    // worker wakes once 'batch_size' items are pending, or at least
+    // every 'interval', and destroys everything queued. Items queued
+    // after the queue has been drained are destroyed immediately.
+    template<typename unused>
+    class basic_reclamation_queue
+    {
+        private:
+            struct node
+            {
+                node *next;
+                void *item;
+                void (*destroy)( void * );
+            };
+
+            template<typename T>
+                static void destroy_item( void *item )
+                {
+                    delete static_cast<T *>( item );
+                }
+
+            // State shared with the worker and with the deleters of
+            // every outstanding item, defined with the container core
+            struct state;
+
+            static void worker( std::shared_ptr<state> shared );
+
+            static void push( const std::shared_ptr<state> &shared, void *item,
+                    void (*destroy)( void * ) );
+
+            // Deleter for items handed out by adopt
+            struct deleter
+            {
+                std::shared_ptr<state> shared;
+                void (*destroy)( void * );
+
+                template<typename T>
+                    void operator()( T *item ) const
+                    {
+                        basic_reclamation_queue::push( shared, item, destroy );
+                    }
+            };
+
+            std::shared_ptr<state> shared;
+
+            basic_reclamation_queue( const basic_reclamation_queue & );
+            basic_reclamation_queue &operator=( const basic_reclamation_queue & );
+
+        public:
+            explicit basic_reclamation_queue( size_t batch_size = 64,
+                    std::chrono::steady_clock::duration interval = 
+                        std::chrono::milliseconds( 10 ) );
+
+            ~basic_reclamation_queue();
+
+            // Take ownership of an item. When its last reference is
+            // released it is queued for destruction.
+            template<typename T>
+                std::shared_ptr<T> adopt( T *item ) const
+                {
+                    deleter d;
+                    d.shared = shared;
+                    d.destroy = &basic_reclamation_queue::destroy_item<T>;
+                    return std::shared_ptr<T>( item, d );
+                }
+
+            // Destroy every item queued before the call on the calling
+            // thread, waiting for any batch the worker is destroying.
+            void flush();
+
+            // Stop the worker and destroy everything queued. Items
+            // released later are destroyed by the releasing thread.
+            void drain();
+
+            // Number of items waiting to be destroyed
+            size_t pending() const;
+    };
+
+    // deferred_factory creates transient items whose destruction is
+    // handed to a reclamation_queue rather than run by the thread
+    // releasing the last reference.
+    template<typename I>
+        class deferred_factory : public resolvable_factory
+        {
+            private:
+                std::shared_ptr<reclamation_queue> queue;
+
+            public:
+                deferred_factory( const std::string &name_in, 
+                        const construction *recipe_in,
+                        std::shared_ptr<reclamation_queue> queue_in )
+                    : resolvable_factory( name_in, recipe_in ), queue( queue_in )
+                {
+                }
+
+                std::shared_ptr<void> create_any( const container &resolver ) const
+                {
+                    return queue->adopt( static_cast<I *>( this->create_item( resolver ) ) );
+                }
+
+                std::shared_ptr<ifactory> clone() const
+                {
+                    return ifactory::share( new deferred_factory( *this ) );
+                }
+
+                size_t footprint() const
+                {
+                    return sizeof(*this) + this->get_plan().footprint();
+                }
+        };
+
+    // resolve_tracer records a span for every resolve made by the
+    // containers it is attached to. Spans nest to mirror the
+    // dependency chain and are written to a buffer per resolving thread
+    // so tracing threads do not contend. The trace can be written in
+    // the Chrome trace event format understood by Perfetto.
+    template<typename unused>
+    class basic_resolve_tracer
+    {
+        public:
+            enum outcome
+            {
+                cache_hit,
+                constructed,
+                failed
+            };
+
+        private:
+            struct event
+            {
+                bool begin;
+                outcome result;
+                unsigned long long time;
+                const std::type_info *type;
+                interned_name name;
+            };
+
+            struct thread_buffer
+            {
+                std::mutex lock;
+                std::vector<event> events;
+                size_t thread;
+            };
+            typedef std::shared_ptr<thread_buffer> buffer_ptr;
+
+            const unsigned long long id;
+            const std::chrono::steady_clock::time_point start;
+            mutable std::mutex lock;
+            std::vector<buffer_ptr> buffers;
+
+            static unsigned long long next_id()
+            {
+                static std::atomic<unsigned long long> last( 0 );
+                return ++last;
+            }
+
+            // The calling thread's buffer for this tracer
+            thread_buffer &local_buffer();
+
+            void record( bool begin, outcome result, const std::type_info &type,
+                    const interned_name &name )
+            {
+                event e;
+                e.begin = begin;
+                e.result = result;
+                e.time = std::chrono::duration_cast<std::chrono::nanoseconds>( 
+                        std::chrono::steady_clock::now() - start ).count();
+                e.type = &type;
+                e.name = name;
+                thread_buffer &buffer = local_buffer();
+                std::lock_guard<std::mutex> guard( buffer.lock );
+                buffer.events.push_back( e );
+            }
+
+            static std::string type_name( const std::type_info &type );
+
+            static void write_string( std::ostream &out, const std::string &value );
+
+            static const char *outcome_name( outcome result );
+
+        public:
+            basic_resolve_tracer() : id( next_id() ), start( std::chrono::steady_clock::now() )
+            {
+            }
+
+            // Open a span for a resolve of the given interface type
+            void begin( const std::type_info &type )
+            {
+                record( true, failed, type, interned_name() );
+            }
+
+            // Close the innermost span of the calling thread. The name is
+            // the registration used, if any, and is held by the span.
+            void end( const std::type_info &type, const interned_name &name, 
+                    outcome result )
+            {
+                record( false, result, type, name );
+            }
+
+            size_t event_count() const;
+
+            void clear();
+
+            // Write every recorded span as Chrome trace event JSON
+            void write_chrome_trace( std::ostream &out ) const;
+    };
+
+
+    // ready_queue is a bounded lock free queue of items for any number
+    // of producers and consumers. Each cell carries a sequence number
+    // saying whether it is free to write or ready to read, so pushing
+    // and popping each take one compare and swap when uncontended.
+    template<typename unused>
+    class basic_ready_queue
+    {
+        private:
+            struct cell
+            {
+                std::atomic<size_t> sequence;
+                std::shared_ptr<void> item;
+            };
+
+            std::unique_ptr<cell[]> cells;
+            size_t mask;
+            // Producers and consumers work on separate cache lines
+            char head_padding[64];
+            std::atomic<size_t> head;
+            char tail_padding[64];
+            std::atomic<size_t> tail;
+
+            basic_ready_queue( const basic_ready_queue & );
+            basic_ready_queue &operator=( const basic_ready_queue & );
+
+        public:
+            // Room for at least 'capacity' items
+            explicit basic_ready_queue( size_t capacity )
+                : head( 0 ), tail( 0 )
+            {
+                size_t size = 2;
+                while( size < capacity )
+                {
+                    size *= 2;
+                }
+                cells.reset( new cell[size] );
+                mask = size - 1;
+                for( size_t i = 0; i < size; ++i )
+                {
+                    cells[i].sequence.store( i, std::memory_order_relaxed );
+                }
+            }
+
+            // Returns false if the queue is full
+            bool push( const std::shared_ptr<void> &item )
+            {
+                size_t position = tail.load( std::memory_order_relaxed );
+                for( ;; )
+                {
+                    cell &current = cells[position & mask];
+                    const size_t sequence = current.sequence.load( std::memory_order_acquire );
+                    if( sequence == position )
+                    {
+                        if( tail.compare_exchange_weak( position, position + 1,
+                                    std::memory_order_relaxed ) )
+                        {
+                            current.item = item;
+                            current.sequence.store( position + 1, std::memory_order_release );
+                            return true;
+                        }
+                    }
+                    else if( static_cast<std::ptrdiff_t>( sequence - position ) < 0 )
+                    {
+                        return false;
+                    }
+                    else
+                    {
+                        position = tail.load( std::memory_order_relaxed );
+                    }
+                }
+            }
+
+            // Returns false if the queue is empty
+            bool pop( std::shared_ptr<void> &item )
+            {
+                size_t position = head.load( std::memory_order_relaxed );
+                for( ;; )
+                {
+                    cell &current = cells[position & mask];
+                    const size_t sequence = current.sequence.load( std::memory_order_acquire );
+                    if( sequence == position + 1 )
+                    {
+                        if( head.compare_exchange_weak( position, position + 1,
+                                    std::memory_order_relaxed ) )
+                        {
+                            item.swap( current.item );
+                            current.sequence.store( position + mask + 1, 
+                                    std::memory_order_release );
+                            return true;
+                        }
+                    }
+                    else if( static_cast<std::ptrdiff_t>( sequence - ( position + 1 ) ) < 0 )
+                    {
+                        return false;
+                    }
+                    else
+                    {
+                        position = head.load( std::memory_order_relaxed );
+                    }
+                }
+            }
+
+            // Number of items, which may be stale by the time it returns
+            size_t size() const
+            {
+                const size_t popped = head.load( std::memory_order_relaxed );
+                const size_t pushed = tail.load( std::memory_order_relaxed );
+                return pushed > popped ? pushed - popped : 0;
+            }
+    };
+    typedef basic_ready_queue<void> ready_queue;
+
+    // Counters of a pooled registration in one container. Resolves
+    // which find a ready item are hits, the rest are misses.
+    struct pool_statistics
+    {
+        size_t low_watermark;
+        size_t high_watermark;
+        size_t ready;
+        unsigned long long hits;
+        unsigned long long misses;
+
+        pool_statistics() : low_watermark( 0 ), high_watermark( 0 ), ready( 0 ),
+            hits( 0 ), misses( 0 )
+        {
+        }
+
+        double hit_rate() const
+        {
+            return hits + misses ? 
+                static_cast<double>( hits ) / static_cast<double>( hits + misses ) : 0.0;
+        }
+    };
+
+    // resolved_item holds an item whose interface type is only known
+    // at run time. The item can be recovered as a shared_ptr of the
+    // exact interface type it was registered for.
+    class resolved_item
+    {
+        private:
+            std::shared_ptr<void> item;
+            const std::type_info *type;
+
+        public:
+            resolved_item() : type( NULL )
+            {
+            }
+
+            resolved_item( const std::shared_ptr<void> &item_in, 
+                    const std::type_info &type_in )
+                : item( item_in ), type( item_in ? &type_in : NULL )
+            {
+            }
+
+            bool empty() const
+            {
+                return !item;
+            }
+
+            // The interface type, typeid(void) when empty
+            const std::type_info &get_type() const
+            {
+                return type ? *type : typeid(void);
+            }
+
+            const std::shared_ptr<void> &get() const
+            {
+                return item;
+            }
+
+            // NULL unless I is the interface type
+            template<typename I>
+                std::shared_ptr<I> as() const
+                {
+                    if( type && *type == typeid(I) )
+                    {
+                        return std::static_pointer_cast<I>( item );
+                    }
+                    return std::shared_ptr<I>();
+                }
+    };
+
+    // Estimated heap usage of a container broken down by category.
+    // Figures are summed from object sizes, capacities and what each
+    // factory reports through footprint(), not measured from the
+    // allocator, so allocator overhead and anything a factory holds
+    // but does not report are missing. They are meant for comparing
+    // configurations rather than exact accounting.
+    struct memory_report
+    {
+        size_t index;       // Per type lookup nodes
+        size_t entries;     // Named registration slots
+        size_t factories;   // Factory objects
+        size_t names;       // Interned registration names
+        size_t singletons;  // Singleton bookkeeping, not the items
+        size_t shared;      // Snapshot layers shared with other containers
+        // Every name interned by the process, including those of other
+        // containers. Not part of total().
+        size_t interned;
+
+        memory_report() : index( 0 ), entries( 0 ), factories( 0 ), 
+            names( 0 ), singletons( 0 ), shared( 0 ), interned( 0 )
+        {
+        }
+
+        size_t total() const
+        {
+            return index + entries + factories + names + singletons + shared;
+        }
+    };
+
+    // container_core declares the part of a container which its member
+    // templates reach. They call through it rather than the container
+    // so that a translation unit which only registers and resolves does
+    // not instantiate the core behind it. Header only the core is
+    // instantiated where a container is constructed or destroyed.
+    class container_core
+    {
+        protected:
+            typedef std::shared_ptr<ifactory> factory_ptr;
+
+            // The construction of the implementation declared for an
+            // instance of an interface template
+            typedef const construction *(*generic_maker)();
+
+            // How to instantiate the generic registrations for an
+            // interface, empty unless the interface is an instance of an
+            // interface template with an implementation template
+            struct generic_hook
+            {
+                const std::type_info *family;
+                generic_maker maker;
+            };
+
+            virtual ~container_core()
+            {
+            }
+
+        private:
+            template<typename unused>
+                friend class basic_container;
+
+            // Registration, see basic_container
+            virtual void add_factory( const std::type_index &type, 
+                    const std::string &name_in, const factory_ptr &undecorated ) = 0;
+            virtual void replace_factory( const std::type_index &type, 
+                    const std::string &name_in, const factory_ptr &factory ) = 0;
+            virtual void store_factory( const std::type_index &type, 
+                    const std::string &name_in, const factory_ptr &factory ) = 0;
+            virtual std::vector<std::pair<const std::string *, factory_ptr>> 
+                visible_factories( const std::type_index &type ) const = 0;
+            virtual void rebind_factories( const std::type_index &type,
+                    const std::shared_ptr<const dependency_bindings> &bindings ) = 0;
+            virtual void add_generic( const std::type_index &family, 
+                    const std::string &name_in, bool shared ) = 0;
+            virtual void bind_key_to( size_t key, const std::type_info &type, 
+                    const interned_name &name_in ) = 0;
+            virtual bool remove_factory_by_name( const std::type_index &type,
+                    const std::string &name_in ) = 0;
+
+            // Lookup
+            virtual std::shared_ptr<void> resolve_shared( const std::type_info &type,
+                    const std::string *name_in, const generic_hook &hook ) const = 0;
+            virtual factory_ptr share_factory( const std::type_info &type, 
+                    const generic_hook &hook, const std::string *name_in ) const = 0;
+            virtual const ifactory *resolve_factory( const std::type_index &type,
+                    const std::string **name_out = NULL ) const = 0;
+            virtual const ifactory *resolve_factory_by_name( 
+                    const std::type_index &type, const std::string &name_in ) const = 0;
+            virtual const ifactory *find_instantiation( const std::type_index &type,
+                    const std::string *name_in ) const = 0;
+            virtual const ifactory *instantiate_family( const std::type_index &type, 
+                    const std::type_index &family, generic_maker maker,
+                    const std::string *name_in ) const = 0;
+            virtual pool_statistics pool_usage( const ifactory *owner ) const = 0;
+    };
+
+    // Container. All object types are registered with the container
+    // at run-time and can then be resolved. Resolver supports
+    // constructor injection.
+    template<typename unused>
+    class basic_container : public container_core
+    {
+        private:
+            template<typename T>
+            struct ellided_deleter
+            {
+                void operator()(T *val)
+                {
+                    // Shhhhh, don't actually delete the ptr.
+                }
+            };
+            typedef ellided_deleter<basic_container> container_deleter;
+
+            // Builds an item for a cached or pooled registration away from the
+            // resolve that asked for it. The factory is held so that it
+            // outlives any build still queued when it is replaced.
+            struct item_builder
+            {
+                std::shared_ptr<const void> factory;
+                const container *resolver;
+                std::shared_ptr<void> (*build)( const void *factory, 
+                        const container &resolver );
+
+                std::shared_ptr<void> operator()() const;
+            };
+
+            // singleton_factory creates its type once per resolving container.
+            // The container keeps the item alive until it is destroyed.
+            class singleton_factory : public resolvable_factory
+            {
+                public:
+                    singleton_factory( const std::string &name_in, 
+                            const construction *recipe_in );
+
+                    void *create_item( const container &resolver ) const;
+
+                    std::shared_ptr<ifactory> clone() const;
+
+                    bool shares_items() const
+                    {
+                        return true;
+                    }
+
+                    std::shared_ptr<void> create_any( const container &resolver ) const;
+            };
+
+            // cached_factory reuses items across resolves from a container until
+            // they expire or are evicted. The factory keeps itself alive for any
+            // refresh still queued when it is replaced.
+            class cached_factory : public resolvable_factory,
+            public std::enable_shared_from_this<cached_factory>
+            {
+                private:
+                    std::chrono::steady_clock::duration ttl;
+                    size_t capacity;
+
+                    static std::shared_ptr<void> build( const void *self,
+                            const container &resolver );
+
+                public:
+                    cached_factory( const std::string &name_in, const construction *recipe_in,
+                            std::chrono::steady_clock::duration ttl_in, size_t capacity_in );
+
+                    // The cache may release an item as soon as it is evicted or
+                    // refreshed, so items are only handed out shared
+                    void *create_item( const container &resolver ) const;
+
+                    std::shared_ptr<ifactory> clone() const;
+
+                    bool shares_items() const
+                    {
+                        return true;
+                    }
+
+                    // Items change when they are refreshed or evicted
+                    bool repeats_items() const
+                    {
+                        return false;
+                    }
+
+                    std::shared_ptr<void> create_any( const container &resolver ) const;
+
+                    std::shared_ptr<void> create_keyed_any( const container &resolver,
+                            const std::string &key ) const;
+
+                    size_t footprint() const;
+            };
+
+            // sharded_factory keeps a replica of its type per shard of the
+            // resolving container. A thread always resolves the same replica.
+            class sharded_factory : public resolvable_factory
+            {
+                private:
+                    size_t shards;
+
+                public:
+                    sharded_factory( const std::string &name_in, 
+                            const construction *recipe_in, unsigned shards_in );
+
+                    void *create_item( const container &resolver ) const;
+
+                    std::shared_ptr<ifactory> clone() const;
+
+                    bool shares_items() const
+                    {
+                        return true;
+                    }
+
+                    // Repeated for the resolving thread, which is all the
+                    // thread cache and resolve_reference rely on
+                    bool repeats_items() const
+                    {
+                        return true;
+                    }
+
+                    std::shared_ptr<void> create_any( const container &resolver ) const;
+
+                    size_t footprint() const;
+            };
+
+            // pooled_factory keeps items of its type built ahead of resolves by
+            // the resolving container's background worker. Every resolve still
+            // receives an item of its own.
+            class pooled_factory : public resolvable_factory,
+            public std::enable_shared_from_this<pooled_factory>
+            {
+                private:
+                    size_t low;
+                    size_t high;
+
+                    static std::shared_ptr<void> build( const void *self,
+                            const container &resolver );
+
+                public:
+                    pooled_factory( const std::string &name_in, const construction *recipe_in,
+                            size_t low_in, size_t high_in );
+
+                    std::shared_ptr<ifactory> clone() const;
+
+                    size_t low_watermark() const
+                    {
+                        return low;
+                    }
+
+                    size_t high_watermark() const
+                    {
+                        return high;
+                    }
+
+                    // Builds items for the pool of a container. The factory
+                    // is kept alive for as long as the pool is.
+                    item_builder creator( const container &resolver ) const;
+
+                    std::shared_ptr<void> create_any( const container &resolver ) const;
+
+                    size_t footprint() const;
+            };
+            
+            // Internal map of registered types -> named registrations of
+            // type factories. Factories are reference counted so that they
+            // can be shared between a snapshot and any number of derived
+            // containers. Each name maps to a slot whose factory can be
+            // swapped atomically while resolvers are reading it. An empty
+            // slot marks a registration which has been removed from this
+            // layer, hiding any registration in a base layer.
+            struct registration_slot
+            {
+                interned_name name;
+                std::atomic<ifactory *> current;
+                factory_ptr owner;
+
+                registration_slot( const interned_name &name_in, 
+                        const factory_ptr &owner_in )
+                    : name( name_in ), current( owner_in.get() ), owner( owner_in )
+                {
+                }
+
+                // Slots are only copied while the registration lock is held
+                registration_slot( const registration_slot &other )
+                    : name( other.name ), 
+                    current( other.current.load( std::memory_order_relaxed ) ),
+                    owner( other.owner )
+                {
+                }
+
+                registration_slot( registration_slot &&other ) noexcept
+                    : name( std::move( other.name ) ), 
+                    current( other.current.load( std::memory_order_relaxed ) ),
+                    owner( std::move( other.owner ) )
+                {
+                }
+
+                registration_slot &operator=( const registration_slot &other )
+                {
+                    name = other.name;
+                    current.store( other.current.load( std::memory_order_relaxed ),
+                            std::memory_order_relaxed );
+                    owner = other.owner;
+                    return *this;
+                }
+
+                registration_slot &operator=( registration_slot &&other ) noexcept
+                {
+                    name = std::move( other.name );
+                    current.store( other.current.load( std::memory_order_relaxed ),
+                            std::memory_order_relaxed );
+                    owner = std::move( other.owner );
+                    return *this;
+                }
+            };
+
+            // The registrations of a single type ordered by name. Names
+            // registered one at a time go into a node based map so that
+            // each registration stays logarithmic however many names a
+            // type has. Batches and snapshots are frozen into a compact
+            // sorted vector, absorbing any loose nodes as they are merged.
+            // Lookups by name go through an open addressed index of slot
+            // positions over both, a few bytes per name rather than a
+            // node. Inserting may move frozen slots, so only lookups are
+            // safe against concurrent writers.
+            class named_factory
+            {
+                private:
+                    typedef std::vector<registration_slot> slot_list;
+
+                    struct name_order
+                    {
+                        bool operator()( const std::string *a, 
+                                const std::string *b ) const
+                        {
+                            return *a < *b;
+                        }
+                    };
+                    typedef std::map<const std::string *, registration_slot, 
+                            name_order> slot_map;
+
+                    // Each bucket holds one more than the position of a
+                    // slot, zero marking an empty bucket. Frozen slots
+                    // come first, then the loose slots. The index is kept
+                    // at most half full so every probe ends.
+                    typedef std::vector<uint32_t> slot_index;
+
+                    slot_list frozen;
+                    slot_map loose;
+                    // Loose slots by their position past the frozen ones
+                    std::vector<registration_slot *> loose_slots;
+                    slot_index index;
+
+                    const registration_slot *at( size_t position ) const
+                    {
+                        return position < frozen.size() ? &frozen[position] :
+                            loose_slots[position - frozen.size()];
+                    }
+
+                    void index_slot( size_t position )
+                    {
+                        const size_t mask = index.size() - 1;
+                        size_t i = std::hash<std::string>()( 
+                                *at( position )->name.get() ) & mask;
+                        while( index[i] )
+                        {
+                            i = ( i + 1 ) & mask;
+                        }
+                        index[i] = static_cast<uint32_t>( position + 1 );
+                    }
+
+                    void reindex()
+                    {
+                        loose_slots.clear();
+                        loose_slots.reserve( loose.size() );
+                        for( typename slot_map::iterator i = loose.begin(); i != loose.end(); ++i )
+                        {
+                            loose_slots.push_back( &i->second );
+                        }
+                        size_t buckets = 1;
+                        while( buckets < 2 * size() )
+                        {
+                            buckets *= 2;
+                        }
+                        slot_index( buckets, 0 ).swap( index );
+                        for( size_t i = 0; i < size(); ++i )
+                        {
+                            index_slot( i );
+                        }
+                    }
+
+                    static bool slot_less( const registration_slot &a,
+                            const registration_slot &b )
+                    {
+                        return *a.name.get() < *b.name.get();
+                    }
+
+                public:
+                    named_factory()
+                    {
+                    }
+
+                    // The index refers to this object's own slots
+                    named_factory( const named_factory &other )
+                        : frozen( other.frozen ), loose( other.loose )
+                    {
+                        reindex();
+                    }
+
+                    named_factory &operator=( const named_factory &other )
+                    {
+                        frozen = other.frozen;
+                        loose = other.loose;
+                        reindex();
+                        return *this;
+                    }
+
+                    // Walks frozen and loose slots together in name order
+                    class const_iterator
+                    {
+                        private:
+                            typename slot_list::const_iterator f, f_end;
+                            typename slot_map::const_iterator l, l_end;
+
+                            bool from_frozen() const
+                            {
+                                return l == l_end || 
+                                    ( f != f_end && *f->name.get() < *l->first );
+                            }
+
+                        public:
+                            typedef std::forward_iterator_tag iterator_category;
+                            typedef registration_slot value_type;
+                            typedef std::ptrdiff_t difference_type;
+                            typedef const registration_slot *pointer;
+                            typedef const registration_slot &reference;
+
+                            const_iterator( typename slot_list::const_iterator f_in,
+                                    typename slot_list::const_iterator f_end_in,
+                                    typename slot_map::const_iterator l_in,
+                                    typename slot_map::const_iterator l_end_in )
+                                : f( f_in ), f_end( f_end_in ), 
+                                l( l_in ), l_end( l_end_in )
+                            {
+                            }
+
+                            const registration_slot &operator*() const
+                            {
+                                return from_frozen() ? *f : l->second;
+                            }
+
+                            const registration_slot *operator->() const
+                            {
+                                return &**this;
+                            }
+
+                            const_iterator &operator++()
+                            {
+                                if( from_frozen() )
+                                {
+                                    ++f;
+                                }
+                                else
+                                {
+                                    ++l;
+                                }
+                                return *this;
+                            }
+
+                            bool operator==( const const_iterator &other ) const
+                            {
+                                return f == other.f && l == other.l;
+                            }
+
+                            bool operator!=( const const_iterator &other ) const
+                            {
+                                return !( *this == other );
+                            }
+                    };
+
+                    const registration_slot *find( const std::string &name_in ) const
+                    {
+                        if( index.empty() )
+                        {
+                            return NULL;
+                        }
+                        const size_t mask = index.size() - 1;
+                        for( size_t i = std::hash<std::string>()( name_in ) & mask; 
+                                index[i]; i = ( i + 1 ) & mask )
+                        {
+                            const registration_slot *slot = at( index[i] - 1 );
+                            if( slot->name.get() == &name_in || 
+                                    *slot->name.get() == name_in )
+                            {
+                                return slot;
+                            }
+                        }
+                        return NULL;
+                    }
+
+                    registration_slot *find( const std::string &name_in )
+                    {
+                        return const_cast<registration_slot *>( 
+                                static_cast<const named_factory *>( this )->find( name_in ) );
+                    }
+
+                    // Add a slot for a name which is not yet present
+                    registration_slot &insert( const interned_name &name_in,
+                            const factory_ptr &factory )
+                    {
+                        registration_slot &slot = loose.insert( typename slot_map::value_type( 
+                                    name_in.get(), registration_slot( name_in, factory ) ) 
+                                ).first->second;
+                        loose_slots.push_back( &slot );
+                        if( 2 * size() > index.size() )
+                        {
+                            reindex();
+                        }
+                        else
+                        {
+                            index_slot( size() - 1 );
+                        }
+                        return slot;
+                    }
+
+                    // Add slots ordered by name, none of which are present,
+                    // folding any loose slots into the frozen vector.
+                    void insert_sorted( const std::vector<registration_slot> &added )
+                    {
+                        if( frozen.empty() && loose.empty() )
+                        {
+                            frozen = added;
+                        }
+                        else
+                        {
+                            slot_list merged;
+                            merged.reserve( size() + added.size() );
+                            std::merge( begin(), end(), added.begin(), added.end(), 
+                                    std::back_inserter( merged ), slot_less );
+                            frozen.swap( merged );
+                            loose.clear();
+                        }
+                        reindex();
+                    }
+
+                    // Detach every factory, last name first, then empty
+                    void release()
+                    {
+                        std::vector<const registration_slot *> order;
+                        order.reserve( size() );
+                        for( const_iterator i = begin(); i != end(); ++i )
+                        {
+                            order.push_back( &*i );
+                        }
+                        for( typename std::vector<const registration_slot *>::reverse_iterator 
+                                i = order.rbegin(); i != order.rend(); ++i )
+                        {
+                            registration_slot *slot = const_cast<registration_slot *>( *i );
+                            slot->current.store( NULL );
+                            slot->owner.reset();
+                        }
+                        index.clear();
+                        loose_slots.clear();
+                        frozen.clear();
+                        loose.clear();
+                    }
+
+                    const_iterator begin() const 
+                    { 
+                        return const_iterator( frozen.begin(), frozen.end(),
+                                loose.begin(), loose.end() ); 
+                    }
+
+                    const_iterator end() const 
+                    { 
+                        return const_iterator( frozen.end(), frozen.end(),
+                                loose.end(), loose.end() ); 
+                    }
+
+                    size_t size() const { return frozen.size() + loose.size(); }
+
+                    // Bytes held for slots, excluding factories and names
+                    size_t footprint() const
+                    {
+                        return frozen.capacity() * sizeof(registration_slot) +
+                            loose.size() * ( map_node_overhead + 
+                                    sizeof(typename slot_map::value_type) ) +
+                            loose_slots.capacity() * sizeof(registration_slot *) +
+                            index.capacity() * sizeof(uint32_t);
+                    }
+            };
+            typedef std::map<std::type_index, named_factory> registration_types;
+
+            // A registry is a single layer of registrations. A container
+            // owns a mutable layer and optionally refers to an immutable
+            // base layer taken from another container. Lookups fall
+            // through to the base only for names the upper layers do not
+            // mention.
+            struct registry
+            {
+                registration_types types;
+                std::shared_ptr<const registry> base;
+            };
+
+        public:
+            // An immutable view of a container's registrations which may
+            // be used to construct any number of derived containers.
+            typedef std::shared_ptr<const registry> snapshot;
+
+        private:
+            registry layer;
+
+            // Serialises changes to the registry. Resolvers never take
+            // it, only replacing a registration is safe against them.
+            mutable std::mutex registration_lock;
+
+            std::shared_ptr<basic_container> self;
+
+            // Identity used to key per thread caches. Unlike the
+            // address it is never reused by a later container.
+            const unsigned long long id;
+            bool thread_cache_enabled;
+            bool graph_allocation_enabled;
+
+            std::shared_ptr<resolve_tracer> tracer_owner;
+            resolve_tracer *tracer;
+
+            // Registration bound to a dense integer key
+            struct key_binding
+            {
+                const std::type_info *type;
+                interned_name name;
+            };
+            std::vector<key_binding> key_bindings;
+
+            // Bumped by every registration change in this container. Base
+            // layers are immutable so changes to other containers never
+            // affect what this one resolves.
+            std::atomic<unsigned long long> generation;
+
+            // Factories for runtime dispatch, rebuilt after a registration
+            // change in this container. Factories are only used while the
+            // table's generation is current, which together with the epoch
+            // held by resolvers keeps them from being released while in use.
+            struct dispatch_table
+            {
+                unsigned long long generation;
+                std::vector<const ifactory *> keys;
+                // Indexed by type_ids
+                std::vector<const ifactory *> types;
+            };
+            mutable std::mutex dispatch_lock;
+            mutable std::atomic<dispatch_table *> dispatch;
+            mutable std::shared_ptr<dispatch_table> dispatch_owner;
+
+            // Span recorded for a single resolve when tracing is enabled.
+            // Resolves which find nothing, or throw, are recorded as failed.
+            class trace_scope
+            {
+                private:
+                    resolve_tracer *tracer;
+                    const std::type_info &type;
+                    const interned_name *name;
+                    resolve_tracer::outcome result;
+                    bool built;
+                    trace_scope *outer;
+
+                    static trace_scope *&innermost()
+                    {
+                        static thread_local trace_scope *scope = NULL;
+                        return scope;
+                    }
+
+                    trace_scope( const trace_scope & );
+                    trace_scope &operator=( const trace_scope & );
+
+                public:
+                    trace_scope( resolve_tracer *tracer_in, const std::type_info &type_in )
+                        : tracer( tracer_in ), type( type_in ), name( NULL ),
+                        result( resolve_tracer::failed ), built( false ), outer( NULL )
+                    {
+                        if( tracer )
+                        {
+                            outer = innermost();
+                            innermost() = this;
+                            tracer->begin( type );
+                        }
+                    }
+
+                    ~trace_scope()
+                    {
+                        if( tracer )
+                        {
+                            innermost() = outer;
+                            tracer->end( type, name ? *name : interned_name(), result );
+                        }
+                    }
+
+                    void hit()
+                    {
+                        result = resolve_tracer::cache_hit;
+                    }
+
+                    // Record the outcome of resolving through a factory
+                    void finish( const ifactory *factory, bool shared, bool resolved )
+                    {
+                        name = &factory->get_interned_name();
+                        result = !resolved ? resolve_tracer::failed : 
+                            shared && !built ? resolve_tracer::cache_hit : 
+                            resolve_tracer::constructed;
+                    }
+
+                    // Note that the innermost resolve constructed a shared item
+                    static void constructed()
+                    {
+                        trace_scope *scope = innermost();
+                        if( scope )
+                        {
+                            scope->built = true;
+                        }
+                    }
+            };
+
+            static unsigned long long next_id()
+            {
+                static std::atomic<unsigned long long> last( 0 );
+                return ++last;
+            }
+
+            void registration_changed()
+            {
+                generation.fetch_add( 1, std::memory_order_acq_rel );
+            }
+
+            friend class registration_batch;
+
+            // The core as templates reach it
+            container_core &core()
+            {
+                return *this;
+            }
+
+            const container_core &core() const
+            {
+                return *this;
+            }
+
+            // A singleton created by this container. Singletons resolved
+            // while another is being constructed are recorded as its
+            // dependencies so that teardown can release dependents first.
+            struct singleton_slot
+            {
+                std::mutex lock;
+                std::atomic<bool> ready;
+                std::shared_ptr<void> item;
+                std::vector<std::shared_ptr<singleton_slot>> dependencies;
+
+                singleton_slot() : ready( false )
+                {
+                }
+            };
+            typedef std::shared_ptr<singleton_slot> slot_ptr;
+            typedef std::map<const ifactory *, slot_ptr> singleton_slots;
+
+            // Singletons are held per container, not per factory, as a
+            // factory may be shared with containers derived from the
+            // same snapshot.
+            mutable std::mutex singleton_lock;
+            mutable singleton_slots singletons;
+
+            unsigned teardown_concurrency;
+            std::chrono::steady_clock::duration teardown_deadline;
+
+            // Items held for a cached registration by the key they were
+            // resolved with, defined with the cache functions
+            struct cache_entry;
+            struct cache_slot;
+            typedef std::shared_ptr<cache_slot> cache_ptr;
+
+            // Like singletons caches are held per container
+            mutable std::mutex cache_lock;
+            mutable std::map<const ifactory *, cache_ptr> caches;
+
+            // Single thread job queue, defined with the rest of the core
+            class background_worker;
+
+            // Refreshes cached items and refills pools, started with
+            // the first job
+            mutable std::unique_ptr<background_worker> refresher;
+
+            // Held while the refresher builds an item and while the
+            // registry changes, so that background builds never resolve
+            // from a registry being changed. Taken before
+            // registration_lock.
+            mutable std::mutex background_lock;
+
+            // One replica of a sharded registration, built the first time
+            // a thread mapped to its shard resolves it.
+            struct replica
+            {
+                std::mutex lock;
+                std::atomic<bool> ready;
+                std::shared_ptr<void> item;
+
+                replica() : ready( false )
+                {
+                }
+            };
+
+            struct replica_set
+            {
+                std::vector<std::unique_ptr<replica>> replicas;
+
+                explicit replica_set( size_t shards )
+                {
+                    replicas.reserve( shards );
+                    for( size_t i = 0; i < shards; ++i )
+                    {
+                        replicas.push_back( std::unique_ptr<replica>( new replica() ) );
+                    }
+                }
+            };
+            typedef std::shared_ptr<replica_set> replica_ptr;
+
+            // Like singletons replicas are held per container
+            mutable std::mutex replica_lock;
+            mutable std::map<const ifactory *, replica_ptr> replica_sets;
+
+            // Shards used when a registration does not choose, one per
+            // hardware thread
+            static unsigned default_shards();
+
+
+            // The replica a thread last resolved for a registration.
+            // Entries are trusted only while no registration of the
+            // container changed.
+            struct replica_cache_entry
+            {
+                unsigned long long container_id;
+                const ifactory *owner;
+                unsigned long long generation;
+                replica *slot;
+            };
+
+            // Threads are spread over shards in the order they first
+            // resolve a sharded registration.
+            static size_t thread_shard()
+            {
+                static std::atomic<size_t> next( 0 );
+                static thread_local size_t shard = next.fetch_add( 1 );
+                return shard;
+            }
+
+            // The calling thread's replica of a sharded registration. The
+            // caller must hold an epoch_guard as replaced registrations
+            // retire their replicas.
+            replica &find_replica( const ifactory *owner, size_t shards ) const
+            {
+                static thread_local std::vector<replica_cache_entry> recent;
+                const unsigned long long generation =
+                    this->generation.load( std::memory_order_seq_cst );
+                typename std::vector<replica_cache_entry>::iterator i = recent.begin();
+                for( ; i != recent.end(); ++i )
+                {
+                    if( i->container_id == id && i->owner == owner )
+                    {
+                        if( i->generation == generation )
+                        {
+                            return *i->slot;
+                        }
+                        break;
+                    }
+                }
+
+                replica_ptr set;
+                {
+                    std::lock_guard<std::mutex> guard( replica_lock );
+                    replica_ptr &result = replica_sets[owner];
+                    if( !result )
+                    {
+                        result.reset( new replica_set( shards ) );
+                    }
+                    set = result;
+                }
+                replica *slot = set->replicas[thread_shard() % set->replicas.size()].get();
+                if( i == recent.end() )
+                {
+                    // Entries for destroyed containers are never matched
+                    if( recent.size() >= 32 )
+                    {
+                        recent.clear();
+                    }
+                    replica_cache_entry entry = { id, owner, generation, slot };
+                    recent.push_back( entry );
+                }
+                else
+                {
+                    i->generation = generation;
+                    i->slot = slot;
+                }
+                return *slot;
+            }
+
+            // Return the calling thread's replica of a sharded
+            // registration, creating it the first time it is resolved.
+            std::shared_ptr<void> resolve_sharded( const ifactory *owner,
+                    size_t shards, const construction_plan &plan ) const;
+
+            // Items built ahead of the resolves of a pooled registration.
+            // A refill is queued whenever fewer than 'low' are ready and
+            // builds items until 'high' are.
+            struct ready_pool : public std::enable_shared_from_this<ready_pool>
+            {
+                ready_queue ready;
+                size_t low;
+                size_t high;
+                item_builder create;
+                std::atomic<bool> refilling;
+                std::atomic<unsigned long long> hits;
+                std::atomic<unsigned long long> misses;
+                // The last failed build, rethrown by the next resolve
+                std::atomic<bool> failed;
+                std::mutex failure_lock;
+                std::exception_ptr failure;
+
+                ready_pool( size_t low_in, size_t high_in, 
+                        const item_builder &create_in )
+                    : ready( high_in ), low( low_in ), high( high_in ),
+                    create( create_in ), refilling( false ), hits( 0 ), misses( 0 ),
+                    failed( false )
+                {
+                }
+            };
+            typedef std::shared_ptr<ready_pool> pool_ptr;
+
+            // Like singletons pools are held per container
+            mutable std::mutex pool_lock;
+            mutable std::map<const ifactory *, pool_ptr> pools;
+
+            // The pool a thread last resolved for a registration, trusted
+            // only while no registration of the container changed
+            struct pool_cache_entry
+            {
+                unsigned long long container_id;
+                const ifactory *owner;
+                unsigned long long generation;
+                ready_pool *pool;
+            };
+
+            // The pool of a pooled registration, created and filled the
+            // first time it is resolved. The caller must hold an
+            // epoch_guard as replaced registrations retire their pools.
+            ready_pool &find_pool( const pooled_factory &factory ) const;
+
+            // Queue a refill unless one is already queued
+            void refill( ready_pool &pool ) const
+            {
+                if( !pool.refilling.load( std::memory_order_relaxed ) &&
+                        !pool.refilling.exchange( true, std::memory_order_acq_rel ) )
+                {
+                    queue_refill( pool.shared_from_this() );
+                }
+            }
+
+            void queue_refill( const pool_ptr &pool ) const;
+
+            // Build items until the pool is at its high watermark. A
+            // failed build stops the refill and is recorded for the next
+            // resolve.
+            static void refill_pool( const pool_ptr &pool );
+
+            // Throw the build failure recorded for a pool, once
+            static void rethrow_failure( ready_pool &pool );
+
+            // Pop a ready item, or build one if there are none
+            std::shared_ptr<void> resolve_pooled( const pooled_factory &factory, 
+                    const construction_plan &plan ) const;
+
+            // Counters of the pool held for a registration
+            pool_statistics pool_usage( const ifactory *owner ) const;
+
+            // Call visitor with every replica built for a registration
+            template<typename I, typename visitor_type>
+                size_t visit_replica_set( const ifactory *owner,
+                        visitor_type &visitor ) const
+                {
+                    replica_ptr set;
+                    {
+                        std::lock_guard<std::mutex> guard( replica_lock );
+                        typename std::map<const ifactory *, replica_ptr>::const_iterator i =
+                            replica_sets.find( owner );
+                        if( i != replica_sets.end() )
+                        {
+                            set = i->second;
+                        }
+                    }
+                    size_t visited = 0;
+                    for( size_t i = 0; set && i < set->replicas.size(); ++i )
+                    {
+                        const replica &slot = *set->replicas[i];
+                        if( slot.ready.load( std::memory_order_acquire ) )
+                        {
+                            visitor( *static_cast<I *>( slot.item.get() ) );
+                            ++visited;
+                        }
+                    }
+                    return visited;
+                }
+
+            // Decorators registered for an interface and the function
+            // which wraps a factory of that interface in them
+            struct decoration
+            {
+                std::shared_ptr<const void> decorators;
+                factory_ptr (*wrap)( const factory_ptr &factory,
+                        const std::shared_ptr<const void> &decorators );
+            };
+
+            // Guarded by registration_lock. Only registrations pay for
+            // decorators, an undecorated factory is stored as it is.
+            std::map<std::type_index, decoration> decorations;
+
+            template<typename I, typename D, typename ...argtypes>
+                static I *decorate_item( const std::shared_ptr<I> &inner,
+                        const container &resolver )
+                {
+                    return new D( inner, dependency<argtypes>::resolve( resolver )... );
+                }
+
+            // Wrap a factory in a chain of decorators, replacing any
+            // chain it is already wrapped in
+            template<typename I>
+                static factory_ptr wrap_factory( const factory_ptr &factory,
+                        const std::shared_ptr<const void> &decorators )
+                {
+                    typedef typename decorated_factory<I>::chain chain;
+                    std::shared_ptr<ifactory> inner = factory;
+                    if( factory->undecorated() != factory.get() )
+                    {
+                        inner = std::static_pointer_cast<decorated_factory<I>>( factory )
+                            ->get_inner();
+                    }
+                    return ifactory::share( new decorated_factory<I>( inner, 
+                                std::static_pointer_cast<const chain>( decorators ) ) );
+                }
+
+            // Guarded by registration_lock. The bindings contextual rules
+            // give the dependencies of each consumer type.
+            std::map<std::type_index, std::shared_ptr<const dependency_bindings>> contexts;
+
+            // Guarded by registration_lock. The generic registrations of
+            // each interface template by name, true for those sharing
+            // their items. has_generics is set by the first of them so
+            // that failed lookups in other containers stay cheap.
+            // Keyed by the address of the name each entry holds
+            typedef std::map<const std::string *, 
+                    std::pair<interned_name, bool>> generic_names;
+            std::map<std::type_index, generic_names> generics;
+            std::atomic<bool> has_generics;
+
+            // Generic registrations instantiated for each interface, kept
+            // apart from the registry so that resolving never changes
+            // what is registered. The table is copied on write under
+            // registration_lock and published atomically, resolvers read
+            // it under an epoch_guard. An interface whose family has no
+            // registrations is recorded with no names.
+            mutable std::atomic<const registration_types *> instantiations;
+            mutable std::shared_ptr<registration_types> instantiations_owner;
+
+            template<typename I>
+                static const construction *make_generic()
+                {
+                    return construction_of<I, typename generic_implementation<I>::type>();
+                }
+
+            template<typename I>
+                static generic_hook generic_hook_for( std::false_type )
+                {
+                    const generic_hook hook = { NULL, NULL };
+                    return hook;
+                }
+
+            template<typename I>
+                static generic_hook generic_hook_for( std::true_type )
+                {
+                    const generic_hook hook = 
+                    { 
+                        generic_instance<I>::family(), &basic_container::make_generic<I> 
+                    };
+                    return hook;
+                }
+
+            template<typename I>
+                static generic_hook generic_hook_for()
+                {
+                    return generic_hook_for<I>( std::integral_constant<bool,
+                            !std::is_void<typename generic_implementation<I>::type>::value>() );
+                }
+
+            // The factory instantiated for 'type' from the generic
+            // registrations of its interface template, by name or the
+            // lowest name
+            const ifactory *instantiate_generic( const std::type_index &type, 
+                    const generic_hook &hook, const std::string *name_in ) const
+            {
+                if( !hook.family || !has_generics.load( std::memory_order_acquire ) )
+                {
+                    return NULL;
+                }
+                return core().instantiate_family( type, *hook.family, hook.maker, name_in );
+            }
+
+            // The instantiation of 'type' by name, or with the lowest name
+            // when 'name_in' is NULL. Names the registry mentions, whether
+            // registered or removed, are skipped. The caller must hold an
+            // epoch_guard.
+            const ifactory *find_instantiation( const std::type_index &type,
+                    const std::string *name_in ) const;
+
+            // Find the instantiation of 'type' as find_instantiation does,
+            // first instantiating 'type' with 'maker' under every name the
+            // interface template 'family' is registered with if it has
+            // not been already.
+            const ifactory *instantiate_family( const std::type_index &type, 
+                    const std::type_index &family, generic_maker maker,
+                    const std::string *name_in ) const;
+
+            // Drop every instantiation after the generic registrations
+            // change. The caller must hold registration_lock.
+            void clear_instantiations();
+
+            void add_generic( const std::type_index &family, 
+                    const std::string &name_in, bool shared );
+
+            // The factory to store for a registration, bound by any
+            // contextual rules and then decorated. The caller must hold
+            // registration_lock.
+            factory_ptr decorate( const std::type_index &type, 
+                    const factory_ptr &factory ) const
+            {
+                if( ( decorations.empty() && contexts.empty() ) || !factory )
+                {
+                    return factory;
+                }
+                factory_ptr result = factory;
+                std::map<std::type_index, std::shared_ptr<const dependency_bindings>>
+                    ::const_iterator c = contexts.find( type );
+                if( c != contexts.end() )
+                {
+                    factory_ptr bound = factory->bind_dependencies( c->second );
+                    if( bound )
+                    {
+                        result = bound;
+                    }
+                }
+                typename std::map<std::type_index, decoration>::const_iterator i = 
+                    decorations.find( type );
+                return i != decorations.end() ? 
+                    i->second.wrap( result, i->second.decorators ) : result;
+            }
+
+            // The registrations of a type visible from this container
+            // and their names. The caller must hold registration_lock.
+            std::vector<std::pair<const std::string *, factory_ptr>> 
+                visible_factories( const std::type_index &type ) const;
+
+            // A reference to the shared item of a factory. Throws a
+            // resolution_exception if there is no such item.
+            template<typename I>
+                I &shared_reference( const ifactory *factory, 
+                        trace_scope &trace ) const
+                {
+                    if( !factory || !factory->repeats_items() )
+                    {
+                        throw resolution_exception( typeid(I).name(), 
+                                factory ? "Registration does not share items" 
+                                : "Not registered" );
+                    }
+                    I *result = static_cast<I *>( factory->create_item( *this ) );
+                    if( !result )
+                    {
+                        throw resolution_exception( typeid(I).name(), "NULL item" );
+                    }
+                    trace.finish( factory, true, true );
+                    return *result;
+                }
+
+            template<typename I>
+                static I moved_value( std::unique_ptr<I> result )
+                {
+                    if( !result )
+                    {
+                        throw resolution_exception( typeid(I).name(), 
+                                "No uniquely owned item" );
+                    }
+                    return std::move( *result );
+                }
+
+            typedef std::vector<std::pair<const basic_container *, singleton_slot *>>
+                construction_stack;
+
+            // Singletons under construction on the calling thread
+            static construction_stack &constructing()
+            {
+                static thread_local construction_stack stack;
+                return stack;
+            }
+
+            struct construction_frame
+            {
+                construction_frame( const basic_container *owner, singleton_slot *slot )
+                {
+                    constructing().push_back( std::make_pair( owner, slot ) );
+                }
+
+                ~construction_frame()
+                {
+                    constructing().pop_back();
+                }
+            };
+
+            cache_ptr find_cache( const ifactory *owner ) const;
+
+            // Return the cached item for a key, creating it if there is
+            // none. Items older than the ttl are still returned while a
+            // replacement is created in the background. A failed refresh
+            // is thrown by the next resolve of its key. Least recently
+            // used keys are evicted beyond the capacity.
+            std::shared_ptr<void> resolve_cached( const ifactory *owner,
+                    const std::string &key, 
+                    std::chrono::steady_clock::duration ttl, size_t capacity,
+                    const item_builder &create ) const;
+
+            // Replace a cached item. A failed refresh keeps the stale item
+            // and records the failure for the next resolve of the key.
+            static void refresh_cached( const cache_ptr &cache, const std::string &key,
+                    const item_builder &create );
+
+            slot_ptr find_singleton_slot( const ifactory *owner ) const
+            {
+                std::lock_guard<std::mutex> guard( singleton_lock );
+                slot_ptr &result = singletons[owner];
+                if( !result )
+                {
+                    result.reset( new singleton_slot() );
+                }
+                return result;
+            }
+
+            // Return the singleton belonging to a factory, creating it
+            // the first time it is resolved.
+            std::shared_ptr<void> resolve_singleton( const ifactory *owner,
+                    const construction_plan &plan ) const;
+
+            // Work shared by the threads tearing down singletons
+            struct teardown_state;
+
+            static void teardown_worker( std::shared_ptr<teardown_state> state );
+
+            // Release every singleton in reverse dependency order.
+            // Singletons which do not depend on each other are released
+            // in parallel when more than one thread is allowed. If a
+            // deadline is set any singletons not yet released when it
+            // expires are abandoned rather than destroyed.
+            void teardown_singletons();
+
+            // Create a shared item. With graph allocation enabled a
+            // transient root and the transient items beneath it are
+            // placed in a single arena sized by earlier resolves.
+            std::shared_ptr<void> create_any( const ifactory *factory ) const;
+
+            // Caches of the shared items each thread resolved from this
+            // container, held here as well as by the thread so that
+            // destroying the container releases what they cached
+            struct thread_cache_slot;
+            mutable std::mutex thread_cache_lock;
+            mutable std::vector<std::shared_ptr<thread_cache_slot>> thread_caches;
+
+            // Index of the calling thread's caches by container
+            class thread_resolve_cache;
+
+            // The calling thread's cache, created on first use
+            thread_cache_slot &local_thread_cache() const;
+
+            // The work of resolve and resolve_by_name, shared by every
+            // interface. The item returned is of type 'type'.
+            std::shared_ptr<void> resolve_shared( const std::type_info &type,
+                    const std::string *name_in, const generic_hook &hook ) const;
+
+            // The owner of the factory resolve or resolve_by_name would use
+            factory_ptr share_factory( const std::type_info &type, 
+                    const generic_hook &hook, const std::string *name_in ) const;
+
+            // The owner of a factory held in one of a type's slots, empty
+            // if no slot holds it
+            static factory_ptr find_owner( const registration_types &types, 
+                    const std::type_index &type, const ifactory *factory );
+
+            // The dispatch table for the current registrations. Callers
+            // must hold an epoch_guard while they use it.
+            const dispatch_table &current_dispatch() const;
+
+            // Resolve through a factory found by runtime dispatch
+            resolved_item resolve_dispatched( const ifactory *factory ) const
+            {
+                trace_scope trace( tracer, factory->get_type() );
+                std::shared_ptr<void> result = create_any( factory );
+                trace.finish( factory, factory->shares_items(), result.get() != NULL );
+                return resolved_item( result, factory->get_type() );
+            }
+
+            void bind_key_to( size_t key, const std::type_info &type, 
+                    const interned_name &name_in );
+
+            // Find the slot for a name in this container's own layer
+            registration_slot *find_own_slot( const std::type_index &type, 
+                    const std::string &name_in )
+            {
+                typename registration_types::iterator i = layer.types.find(type);
+                return i != layer.types.end() ? i->second.find(name_in) : NULL;
+            }
+
+            // Drop the state this container keeps for a factory which is
+            // no longer registered, as its address may be reused once it
+            // is released. The state, singletons and cached items as well
+            // as the replicas and pools resolvers may still be using, is
+            // added to 'retired' so no item is destroyed under the
+            // caller's locks.
+            void release_state( const ifactory *factory,
+                    std::vector<std::shared_ptr<void>> &retired );
+
+            // Publish a new factory in a slot and retire the previous one.
+            // Resolvers see either factory, never neither, and the old
+            // one is released once no resolver can still be inside it.
+            void publish( registration_slot &slot, const factory_ptr &factory );
+
+            // Registration helper. Only the container's own layer is
+            // checked for duplicates so that a derived container may
+            // override registrations inherited from its snapshot.
+            void add_factory( const std::type_index &type, 
+                    const std::string &name_in, const factory_ptr &undecorated );
+
+            // Atomically replace a registration. If there is none in this
+            // container's own layer the factory is registered as usual.
+            void replace_factory( const std::type_index &type, 
+                    const std::string &name_in, const factory_ptr &factory );
+
+            // Store a factory in this container's own layer, replacing
+            // any it holds for the name. The caller must hold
+            // registration_lock.
+            void store_factory( const std::type_index &type, 
+                    const std::string &name_in, const factory_ptr &factory );
+
+            template<typename F, typename I, typename ...argtypes>
+                void register_with_name_template( const std::string &name_in,
+                        argtypes... args )
+                {
+                    core().add_factory( std::type_index(typeid(I)), name_in, 
+                            own_factory( new F( name_in, args... ) ) );
+                }
+
+            // Bind the registrations of a consumer type visible from this
+            // container, those of base layers are overridden in this one
+            void rebind_factories( const std::type_index &type,
+                    const std::shared_ptr<const dependency_bindings> &bindings );
+
+            // Check if any layer above 'until' mentions the given name,
+            // either as a registration or as a removal.
+            bool is_shadowed( const std::type_index &type, 
+                    const std::string &name_in, const registry *until ) const;
+            
+            // Resolve factory for interface. If that fails then return NULL.
+            // The factory with the lowest visible name across all layers
+            // is chosen, matching the behaviour of a single flat registry.
+            const ifactory *resolve_factory( const std::type_index &type,
+                    const std::string **name_out = NULL ) const;
+
+            // Resolve factory for interface type by name. 
+            // If that fails then return NULL.
+            const ifactory *
+                resolve_factory_by_name( const std::type_index &type, 
+                        const std::string &name_in ) const;
+
+            // Remove a single named registration from this container. The
+            // slot is emptied rather than erased so that it also masks any
+            // registration of the same name in a base layer, and the
+            // factory is retired rather than destroyed immediately.
+            bool remove_factory_by_name( const std::type_index &type,
+                    const std::string &name_in );
+
+            // Estimated bookkeeping per node of a std::map, the colour
+            // and the parent and child links.
+            static const size_t map_node_overhead = 4 * sizeof(void *);
+
+            // Add the usage of a single layer to a report. Factories and
+            // names already seen in another layer are not counted again.
+            struct seen_set;
+            static void layer_usage( const registry &l, memory_report &report,
+                    seen_set &seen );
+
+        public:
+            basic_container();
+
+            // Construct a container which shares all registrations held
+            // by the snapshot. Registrations made on this container
+            // override those of the snapshot without affecting it or any
+            // other container derived from it. Construction costs the
+            // same regardless of the number of registrations in the base.
+            explicit basic_container( const snapshot &base_in );
+
+            ~basic_container();
+
+            // Take an immutable snapshot of every registration visible
+            // from this container. Only this container's own layer is
+            // copied, factories themselves are shared rather than cloned.
+            // The container's own self registration is not included, a
+            // derived container registers itself instead.
+            snapshot take_snapshot() const;
+
+            // Check if a factory to create a gievn interface
+            // already exists
+            template<typename I>
+                bool type_is_registered( const std::string &name_in ) const
+                {
+                    epoch_guard guard;
+                    const std::type_index type( typeid(I) );
+                    const ifactory *f = core().resolve_factory_by_name( type, name_in );    
+                    return f || core().find_instantiation( type, &name_in ) ? true : false;
+                }
+
+            template<typename I>
+                bool type_is_registered() const
+                {
+                    epoch_guard guard;
+                    const std::type_index type( typeid(I) );
+                    const ifactory *f = core().resolve_factory( type );    
+                    return f || core().find_instantiation( type, NULL ) ? true : false;
+                }
+
+
+
+            // Add every registration in a batch. The batch is checked for
+            // duplicates, both within itself and against this container,
+            // before anything is registered so a failing batch leaves the
+            // container unchanged. A batch may be added to any number of
+            // containers, which then share its factories.
+            void register_batch( const registration_batch &batch );
+
+            template<typename I, typename callable, typename ...argtypes>
+                void register_delegate_with_name( const std::string &name_in,
+                        callable call_obj )
                 {
                     // Create a functor which returns an Interface type
                     // but actually news a Concretion.
                     typedef delegate_factory<I, callable, argtypes...> 
                         factorytype;
                     register_with_name_template<factorytype, I,
-                        ioc::container &, callable>( name_in, *this, call_obj );
+                        callable>( name_in, call_obj );
+                }
+
+            template<typename I, typename callable, typename ...argtypes>
+                void register_delegate( callable call_obj )
+                {
+                    // Register nameless delegate constructor
+                    register_delegate_with_name<I, callable, argtypes...>( 
+                            unnamed_type_name_registration, call_obj );
+                }
+
+            template<typename I, typename T, typename ...argtypes>
+                void register_type_with_name( const std::string &name_in )
+                {
+                    core().add_factory( std::type_index(typeid(I)), name_in, 
+                            own_factory( new resolvable_factory( name_in, 
+                                    construction_of<I, T, argtypes...>() ) ) );
+                }
+
+            template<typename I, typename T, typename ...argtypes>
+                void register_type()
+                {
+                    // Register nameless constructor object
+                    register_type_with_name<I, T, argtypes...>( 
+                            unnamed_type_name_registration );
+                }
+
+            // Register a type which is created on first resolve and then
+            // shared by every later resolve from this container.
+            template<typename I, typename T, typename ...argtypes>
+                void register_singleton_with_name( const std::string &name_in )
+                {
+                    core().add_factory( std::type_index(typeid(I)), name_in, 
+                            own_factory( new singleton_factory( name_in, 
+                                    construction_of<I, T, argtypes...>() ) ) );
+                }
+
+            template<typename I, typename T, typename ...argtypes>
+                void register_singleton()
+                {
+                    register_singleton_with_name<I, T, argtypes...>( 
+                            unnamed_type_name_registration );
+                }
+
+            // Register a transient type whose items are destroyed by a
+            // reclamation_queue once their last reference is released.
+            // Items resolved with sole ownership are destroyed as usual.
+            template<typename I, typename T, typename ...argtypes>
+                void register_deferred_with_name( const std::string &name_in,
+                        std::shared_ptr<reclamation_queue> queue )
+                {
+                    core().add_factory( std::type_index(typeid(I)), name_in, 
+                            own_factory( new deferred_factory<I>( name_in, 
+                                    construction_of<I, T, argtypes...>(), queue ) ) );
+                }
+
+            template<typename I, typename T, typename ...argtypes>
+                void register_deferred( std::shared_ptr<reclamation_queue> queue )
+                {
+                    register_deferred_with_name<I, T, argtypes...>( 
+                            unnamed_type_name_registration, queue );
+                }
+
+            // Register a type whose items are reused by later resolves.
+            // Items older than 'ttl' are replaced in the background while
+            // resolves continue to receive the stale item, a zero ttl
+            // never expires them. Items are cached per resolve-time key
+            // and least recently used keys are evicted once there are
+            // more than 'capacity', zero for no limit.
+            template<typename I, typename T, typename ...argtypes>
+                void register_cached_with_name( const std::string &name_in,
+                        std::chrono::steady_clock::duration ttl, size_t capacity = 0 )
+                {
+                    core().add_factory( std::type_index(typeid(I)), name_in, 
+                            own_factory( new cached_factory( name_in, 
+                                    construction_of<I, T, argtypes...>(), ttl, capacity ) ) );
+                }
+
+            template<typename I, typename T, typename ...argtypes>
+                void register_cached( std::chrono::steady_clock::duration ttl, 
+                        size_t capacity = 0 )
+                {
+                    register_cached_with_name<I, T, argtypes...>( 
+                            unnamed_type_name_registration, ttl, capacity );
+                }
+
+            // Register a type replicated per shard for read-mostly
+            // services resolved from many threads. Each resolving thread
+            // is mapped to one of 'shards' replicas, by default one per
+            // hardware thread, which is built the first time a thread
+            // mapped to it resolves. Replicas live until the container is
+            // destroyed. Use visit_replicas to aggregate over them.
+            template<typename I, typename T, typename ...argtypes>
+                void register_sharded_with_name( const std::string &name_in,
+                        unsigned shards = 0 )
+                {
+                    core().add_factory( std::type_index(typeid(I)), name_in, 
+                            own_factory( new sharded_factory( name_in, 
+                                    construction_of<I, T, argtypes...>(), shards ) ) );
                 }
 
-            template<typename I, typename callable, typename ...argtypes>
-                void register_delegate( callable call_obj )
+            template<typename I, typename T, typename ...argtypes>
+                void register_sharded( unsigned shards = 0 )
                 {
-                    // Register nameless delegate constructor
-                    register_delegate_with_name<I, callable, argtypes...>( 
-                            unnamed_type_name_registration, call_obj );
+                    register_sharded_with_name<I, T, argtypes...>(
+                            unnamed_type_name_registration, shards );
+                }
+
+            // Decorate every item resolved for interface I with a D, which
+            // implements I and is constructed from the item it wraps
+            // followed by its resolved 'argtypes'. Decorators wrap in the
+            // order they are registered, the first innermost. They apply
+            // to all registrations of I visible from this container, now
+            // or later, and the chain is built here rather than when
+            // resolving. Interfaces without decorators are unaffected.
+            template<typename I, typename D, typename ...argtypes>
+                void register_decorator()
+                {
+                    typedef typename decorated_factory<I>::chain chain;
+                    const std::type_index type( typeid(I) );
+                    retire_scope reclaim;
+                    std::lock_guard<std::mutex> quiet( background_lock );
+                    std::lock_guard<std::mutex> guard( registration_lock );
+                    decoration &entry = decorations[type];
+                    std::shared_ptr<chain> decorators( new chain() );
+                    if( entry.decorators )
+                    {
+                        *decorators = *std::static_pointer_cast<const chain>( 
+                                entry.decorators );
+                    }
+                    decorators->push_back( &basic_container::decorate_item<I, D, argtypes...> );
+                    entry.decorators = std::shared_ptr<const chain>( decorators );
+                    entry.wrap = &basic_container::wrap_factory<I>;
+
+                    // Rewrap the registrations visible from every layer,
+                    // those of base layers are overridden in this one.
+                    const std::vector<std::pair<const std::string *, factory_ptr>> 
+                        visible = core().visible_factories( type );
+                    for( size_t i = 0; i < visible.size(); ++i )
+                    {
+                        core().store_factory( type, *visible[i].first,
+                                entry.wrap( visible[i].second, entry.decorators ) );
+                    }
+                }
+
+            // When constructing items registered as X, resolve arguments
+            // asking for an I from the registration of I named 'name_in'
+            // rather than the unnamed one. Rules apply to registrations of
+            // X visible from this container, now or later, that are made
+            // with a type or a delegate. The name an argument is bound to
+            // is looked up here so resolving it costs no more than an
+            // unbound argument. Items already shared by X are rebuilt.
+            template<typename X, typename I>
+                void register_contextual( const std::string &name_in )
+                {
+                    const std::type_index type( typeid(X) );
+                    retire_scope reclaim;
+                    std::lock_guard<std::mutex> quiet( background_lock );
+                    std::lock_guard<std::mutex> guard( registration_lock );
+                    std::shared_ptr<const dependency_bindings> &entry = contexts[type];
+                    std::shared_ptr<dependency_bindings> rules( new dependency_bindings() );
+                    if( entry )
+                    {
+                        *rules = *entry;
+                    }
+                    rules->bind( typeid(I), interned_name( name_in ) );
+                    entry = rules;
+                    core().rebind_factories( type, entry );
+                }
+
+            // Register the implementation template declared for the
+            // interface template F with IOC_GENERIC_IMPLEMENTATION. The
+            // factory for an F<T> is made when F<T> is first resolved
+            // and is then kept as an ordinary registration, so only the
+            // instantiations in use cost anything. Generic singletons
+            // share one item per instantiation.
+            template<template<typename...> class F>
+                void register_generic_with_name( const std::string &name_in )
+                {
+                    core().add_generic( typeid(generic_family<F>), name_in, false );
+                }
+
+            template<template<typename...> class F>
+                void register_generic()
+                {
+                    register_generic_with_name<F>( unnamed_type_name_registration );
+                }
+
+            template<template<typename...> class F>
+                void register_generic_singleton_with_name( const std::string &name_in )
+                {
+                    core().add_generic( typeid(generic_family<F>), name_in, true );
+                }
+
+            template<template<typename...> class F>
+                void register_generic_singleton()
+                {
+                    register_generic_singleton_with_name<F>( 
+                            unnamed_type_name_registration );
                 }
 
+            // Register a transient type whose items are built ahead of
+            // time by a background worker. Resolves take a ready item if
+            // there is one and otherwise build their own. Whenever fewer
+            // than 'low' items are ready the worker builds them until
+            // 'high' are. The pool is first filled by the first resolve,
+            // so its items see every registration made before it. A
+            // build failing in the background is thrown by the next
+            // resolve.
             template<typename I, typename T, typename ...argtypes>
-                void register_type_with_name( const std::string &name_in )
+                void register_pooled_with_name( const std::string &name_in,
+                        size_t low, size_t high )
                 {
-                    typedef resolvable_factory<I, T, argtypes...> factorytype;
-                    register_with_name_template<factorytype, I, 
-                        ioc::container &>( name_in, *this );
+                    core().add_factory( std::type_index(typeid(I)), name_in, 
+                            own_factory( new pooled_factory( name_in, 
+                                    construction_of<I, T, argtypes...>(), low, high ) ) );
                 }
 
             template<typename I, typename T, typename ...argtypes>
-                void register_type()
+                void register_pooled( size_t low, size_t high )
                 {
-                    // Register nameless constructor object
-                    register_type_with_name<I, T, argtypes...>( 
-                            unnamed_type_name_registration );
+                    register_pooled_with_name<I, T, argtypes...>( 
+                            unnamed_type_name_registration, low, high );
                 }
 
+            // Configure how singletons are released when the container
+            // is destroyed. Up to 'threads' independent singletons are
+            // released concurrently. A non-zero deadline bounds how long
+            // destruction waits, singletons still alive at the deadline
+            // are abandoned.
+            void set_teardown_concurrency( unsigned threads )
+            {
+                teardown_concurrency = threads;
+            }
+
+            void set_teardown_deadline( std::chrono::steady_clock::duration deadline )
+            {
+                teardown_deadline = deadline;
+            }
+
             template<typename I>
                 void register_instance_with_name( const std::string &name_in,
                         std::shared_ptr<I> instance_in )
@@ -441,32 +3801,349 @@ namespace ioc
                             unnamed_type_name_registration, instance_in );
                 }
 
+            // Register a user supplied factory. This is the extension
+            // point used by registration kinds living outside this
+            // header.
+            template<typename I>
+                void register_factory_with_name( const std::string &name_in,
+                        std::shared_ptr<base_factory<I>> factory_in )
+                {
+                    core().add_factory( std::type_index(typeid(I)), name_in, factory_in );
+                }
+
+            template<typename I>
+                void register_factory( std::shared_ptr<base_factory<I>> factory_in )
+                {
+                    register_factory_with_name<I>( 
+                            unnamed_type_name_registration, factory_in );
+                }
+
+            // Atomically replace an existing registration. Concurrent
+            // resolvers see either the old or the new factory, and the
+            // old factory is released only once no resolver can still be
+            // using it. Unlike other registration changes this may be
+            // called while other threads are resolving, provided the
+            // name is already registered in this container's own layer.
+            // Otherwise the factory is registered as usual.
+            template<typename I>
+                void replace_factory_with_name( const std::string &name_in,
+                        std::shared_ptr<base_factory<I>> factory_in )
+                {
+                    core().replace_factory( std::type_index(typeid(I)), name_in, 
+                            factory_in );
+                }
+
+            template<typename I, typename T, typename ...argtypes>
+                void replace_registration( const std::string &name_in )
+                {
+                    core().replace_factory( std::type_index(typeid(I)), name_in, 
+                            ifactory::share( new resolvable_factory( name_in,
+                                    construction_of<I, T, argtypes...>() ) ) );
+                }
+
+            template<typename I, typename T, typename ...argtypes>
+                void replace_registration()
+                {
+                    replace_registration<I, T, argtypes...>( 
+                            unnamed_type_name_registration );
+                }
+
+            // Estimate the memory held by this container from the sizes
+            // its tables and factories report, see memory_report. Layers
+            // inherited from a snapshot are reported as shared as they
+            // are held only once however many containers derive from them.
+            memory_report memory_usage() const;
+
+            // Release retired factories no resolver can still reference.
+            // This also happens after every change that retires one,
+            // once the change has released the container's locks.
+            static void reclaim_retired()
+            {
+                epoch_domain::instance().collect();
+            }
+
+            // Lookup the factory resolve<I>() would use. If there
+            // is none then return NULL. Callers racing with
+            // replace_registration must hold an epoch_guard for as long
+            // as they use the factory.
+            template<typename I>
+                const ifactory *get_factory() const
+                {
+                    const ifactory *factory = core().resolve_factory( 
+                            std::type_index(typeid(I)) );
+                    if( !factory )
+                    {
+                        factory = instantiate_generic( typeid(I), 
+                                generic_hook_for<I>(), NULL );
+                    }
+                    return factory;
+                }
+
+            template<typename I>
+                const ifactory *get_factory_by_name( const std::string &name_in ) const
+                {
+                    const ifactory *factory = core().resolve_factory_by_name( 
+                            std::type_index(typeid(I)), name_in );
+                    if( !factory )
+                    {
+                        factory = instantiate_generic( typeid(I), 
+                                generic_hook_for<I>(), &name_in );
+                    }
+                    return factory;
+                }
+
+            // As get_factory, but the factory is shared rather than
+            // borrowed so that it may be used without an epoch_guard,
+            // for example across the suspension points of a coroutine.
+            template<typename I>
+                std::shared_ptr<const ifactory> share_factory() const
+                {
+                    return core().share_factory( typeid(I), generic_hook_for<I>(), NULL );
+                }
+
+            template<typename I>
+                std::shared_ptr<const ifactory> 
+                share_factory_by_name( const std::string &name_in ) const
+                {
+                    return core().share_factory( typeid(I), generic_hook_for<I>(), &name_in );
+                }
+
+            // Cache shared items, such as registered instances, per
+            // resolving thread. Repeated resolves of those items then
+            // skip the registry and avoid contending on the item's
+            // reference count. Any registration change in the container
+            // invalidates its caches. Cached references are released
+            // when a thread next resolves after such a change, when the
+            // thread exits, by clear_thread_cache or when the container
+            // is destroyed.
+            void enable_thread_cache( bool enabled = true )
+            {
+                thread_cache_enabled = enabled;
+                registration_changed();
+            }
+
+            // Construct each transient item resolved from this container
+            // in one contiguous block together with the transient items
+            // it depends on, rather than allocating every item and its
+            // control block separately. The block is sized by the first
+            // resolve of each registration and is released once the
+            // whole graph has been destroyed. Only items created by
+            // register_type registrations are placed in the block.
+            void enable_graph_allocation( bool enabled = true )
+            {
+                graph_allocation_enabled = enabled;
+            }
+
+            // Record a span for every resolve made through this container
+            // with the given tracer, or stop tracing if it is empty. Set
+            // the tracer before resolving from other threads.
+            void set_tracer( std::shared_ptr<resolve_tracer> tracer_in )
+            {
+                tracer_owner = tracer_in;
+                tracer = tracer_in.get();
+            }
+
+            // Release the calling thread's cached items
+            static void clear_thread_cache();
+
             // Resolve interface type. If that fails then return NULL.
             template<typename I>
                 std::shared_ptr<I> resolve() const
                 {
-                    I *result = NULL;
-                    const ifactory *factory = resolve_factory<I>();
+                    return std::static_pointer_cast<I>( 
+                            core().resolve_shared( typeid(I), NULL, generic_hook_for<I>() ) );
+                }
+
+            // Resolve interface type passing trailing arguments to the
+            // constructor or delegate parameters declared as
+            // ioc::argument<A> anywhere in the graph, rather than
+            // registering them as instances. Arguments are matched by
+            // type. Items shared by their registration keep the
+            // arguments they were first resolved with.
+            template<typename I, typename A, typename ...argtypes>
+                std::shared_ptr<I> resolve( A &&first, argtypes &&...rest ) const
+                {
+                    const runtime_arguments::value values[] = 
+                    { 
+                        runtime_arguments::value( first ), 
+                        runtime_arguments::value( rest )... 
+                    };
+                    runtime_arguments frame( values, 1 + sizeof...(argtypes) );
+                    return resolve<I>();
+                }
+
+            template<typename I, typename A, typename ...argtypes>
+                std::shared_ptr<I> resolve_by_name( const std::string &name_in, 
+                        A &&first, argtypes &&...rest ) const
+                {
+                    const runtime_arguments::value values[] = 
+                    { 
+                        runtime_arguments::value( first ), 
+                        runtime_arguments::value( rest )... 
+                    };
+                    runtime_arguments frame( values, 1 + sizeof...(argtypes) );
+                    return resolve_by_name<I>( name_in );
+                }
+
+            // Resolve interface type by name. If that fails then return NULL.
+            template<typename I>
+                std::shared_ptr<I> resolve_by_name( const std::string &name_in ) const
+                {
+                    return std::static_pointer_cast<I>( 
+                            core().resolve_shared( typeid(I), &name_in, generic_hook_for<I>() ) );
+                }
+
+            // Resolve interface type for a key. Cached registrations keep
+            // an item per key, other registrations ignore the key.
+            template<typename I>
+                std::shared_ptr<I> resolve_keyed( const std::string &key ) const
+                {
+                    trace_scope trace( tracer, typeid(I) );
+                    epoch_guard guard;
+                    const ifactory *factory = get_factory<I>();
                     if( factory )
                     {
-                        result = reinterpret_cast<I *>( factory->create_item() );
+                        std::shared_ptr<I> result = std::static_pointer_cast<I>( 
+                                factory->create_keyed_any( *this, key ) );
+                        trace.finish( factory, factory->shares_items(), result.get() != NULL );
+                        return result;
                     }
+                    return std::shared_ptr<I>();
+                }
 
-                    return std::shared_ptr<I>(result);
+            // Bind a dense integer key to the registration resolve<I>()
+            // would use, or to a named registration. Keys index a table
+            // directly so they should be small and densely packed.
+            template<typename I>
+                void bind_key( size_t key )
+                {
+                    core().bind_key_to( key, typeid(I), interned_name() );
                 }
 
-            // Resolve interface type by name. If that fails then return NULL.
             template<typename I>
-                std::shared_ptr<I> resolve_by_name( const std::string &name_in ) const
+                void bind_key_with_name( size_t key, const std::string &name_in )
+                {
+                    core().bind_key_to( key, typeid(I), interned_name( name_in ) );
+                }
+
+            // Resolve the registration bound to a key. If there is none
+            // then the item returned is empty.
+            resolved_item resolve_key( size_t key ) const;
+
+            // Resolve an interface type given at run time, as resolve<I>()
+            // would. If that fails then the item returned is empty.
+            resolved_item resolve_any( const std::type_index &type ) const;
+
+            // As resolve_any for the type with the given type_ids id,
+            // which indexes the dispatch table directly
+            resolved_item resolve_id( size_t type_id ) const;
+
+            // Resolve interface type with sole ownership. If that fails, or
+            // the registration shares its items, then return NULL.
+            template<typename I>
+                std::unique_ptr<I> resolve_unique() const
+                {
+                    trace_scope trace( tracer, typeid(I) );
+                    epoch_guard guard;
+                    const ifactory *factory = get_factory<I>();
+                    if( factory )
+                    {
+                        std::unique_ptr<I> result( 
+                                static_cast<I *>( factory->create_owned( *this ) ) );
+                        trace.finish( factory, false, result.get() != NULL );
+                        return result;
+                    }
+                    return std::unique_ptr<I>();
+                }
+
+            template<typename I>
+                std::unique_ptr<I> 
+                resolve_unique_by_name( const std::string &name_in ) const
                 {
-                    I *result = NULL;
-                    const ifactory *factory = 
-                        resolve_factory_by_name<I>( name_in );
+                    trace_scope trace( tracer, typeid(I) );
+                    epoch_guard guard;
+                    const ifactory *factory = get_factory_by_name<I>( name_in );
                     if( factory )
                     {
-                        result = reinterpret_cast<I *>( factory->create_item() );
+                        std::unique_ptr<I> result( 
+                                static_cast<I *>( factory->create_owned( *this ) ) );
+                        trace.finish( factory, false, result.get() != NULL );
+                        return result;
                     }
-                    return std::shared_ptr<I>(result);
+                    return std::unique_ptr<I>();
+                }
+
+            // Resolve a reference to a shared item such as a registered
+            // instance. The item is kept alive by its registration so no
+            // reference count is taken. Throws a resolution_exception if
+            // the type is not registered or its items are not shared.
+            template<typename I>
+                I &resolve_reference() const
+                {
+                    trace_scope trace( tracer, typeid(I) );
+                    epoch_guard guard;
+                    return shared_reference<I>( get_factory<I>(), trace );
+                }
+
+            template<typename I>
+                I &resolve_reference_by_name( const std::string &name_in ) const
+                {
+                    trace_scope trace( tracer, typeid(I) );
+                    epoch_guard guard;
+                    return shared_reference<I>( get_factory_by_name<I>( name_in ), trace );
+                }
+
+            // Resolve a uniquely owned item and move it out by value.
+            // Throws a resolution_exception if there is no such item.
+            template<typename I>
+                I resolve_value() const
+                {
+                    return moved_value<I>( resolve_unique<I>() );
+                }
+
+            template<typename I>
+                I resolve_value_by_name( const std::string &name_in ) const
+                {
+                    return moved_value<I>( resolve_unique_by_name<I>( name_in ) );
+                }
+
+            // Counters of the pooled registration resolve<I>() would use.
+            // Other registrations report no pool.
+            template<typename I>
+                pool_statistics get_pool_statistics() const
+                {
+                    epoch_guard guard;
+                    const ifactory *factory = get_factory<I>();
+                    return factory ? core().pool_usage( factory->undecorated() ) : pool_statistics();
+                }
+
+            template<typename I>
+                pool_statistics get_pool_statistics_by_name( const std::string &name_in ) const
+                {
+                    epoch_guard guard;
+                    const ifactory *factory = get_factory_by_name<I>( name_in );
+                    return factory ? core().pool_usage( factory->undecorated() ) : pool_statistics();
+                }
+
+            // Call visitor( I & ) with every replica built so far for the
+            // sharded registration resolve<I>() would use. Replicas may
+            // be in use by other threads while they are visited. Returns
+            // the number of replicas visited.
+            template<typename I, typename visitor_type>
+                size_t visit_replicas( visitor_type visitor ) const
+                {
+                    epoch_guard guard;
+                    const ifactory *factory = get_factory<I>();
+                    return factory ? visit_replica_set<I>( factory, visitor ) : 0;
+                }
+
+            template<typename I, typename visitor_type>
+                size_t visit_replicas_by_name( const std::string &name_in,
+                        visitor_type visitor ) const
+                {
+                    epoch_guard guard;
+                    const ifactory *factory = get_factory_by_name<I>( name_in );
+                    return factory ? visit_replica_set<I>( factory, visitor ) : 0;
                 }
 
             // Destroy all factories implementing the given interface
@@ -474,16 +4151,14 @@ namespace ioc
                 bool remove_registration()
                 {
                     bool result = false;
-                    registration_types::iterator i = types.find(std::type_index(typeid(I)));
-                    if( i != types.end() )
+                    const std::type_index type(typeid(I));
+                    // Removing a name changes which registration is
+                    // visible so always restart from the lowest one.
+                    const std::string *name_in = NULL;
+                    while( core().resolve_factory( type, &name_in ) )
                     {
-                        for( named_factory::iterator j = i->second.begin(); 
-                                j != i->second.end(); ++j )
-                        {
-                            destroy_factory( j->second );
-                        }
-                        types.erase(i);
-                        result = true;
+                        // Interned names outlive the registration
+                        result = core().remove_factory_by_name( type, *name_in );
                     }
                     return result;
                 }
@@ -493,21 +4168,177 @@ namespace ioc
             template<typename I>
                 bool remove_registration_by_name( const std::string &name_in )
                 {
-                    bool result = false;
-                    registration_types::iterator i = types.find(std::type_index(typeid(I)));
-                    if( i != types.end() )
-                    {
-                        named_factory::iterator j = i->second.find(name_in); 
-                        if( j != i->second.end() )
-                        {
-                            destroy_factory( j->second );
-                            i->second.erase( j );
-                           result = true; 
-                        }
-                    }
-                    return result;
+                    return core().remove_factory_by_name( 
+                            std::type_index(typeid(I)), name_in );
                 }
     }; // namespace IOC
+
+#if defined(IOC_SEPARATE_COMPILATION)
+    // The templates defined with the core are instantiated once, by
+    // ioc.cpp
+    extern template class basic_epoch_domain<void>;
+    extern template class basic_type_ids<void>;
+    extern template class basic_reclamation_queue<void>;
+    extern template class basic_resolve_tracer<void>;
+    extern template class basic_container<void>;
+#endif
+
+    // registration_batch collects registrations to be added to a
+    // container in one step. Duplicates are found with a single sort
+    // and storage for each type is sized once, which is considerably
+    // cheaper than registering a large number of types one by one.
+    class registration_batch
+    {
+        private:
+            friend container;
+
+            struct entry
+            {
+                std::type_index type;
+                interned_name name;
+                std::shared_ptr<ifactory> factory;
+
+                entry( const std::type_index &type_in, const interned_name &name_in,
+                        const std::shared_ptr<ifactory> &factory_in )
+                    : type( type_in ), name( name_in ), factory( factory_in )
+                {
+                }
+            };
+
+            // Entries are ordered as the container stores them
+            static bool entry_less( const entry *a, const entry *b )
+            {
+                if( a->type != b->type )
+                {
+                    return a->type < b->type;
+                }
+                return a->name.get() != b->name.get() && 
+                    *a->name.get() < *b->name.get();
+            }
+
+            std::vector<entry> entries;
+
+            template<typename F, typename I, typename ...argtypes>
+                void add_with_name_template( const std::string &name_in,
+                        argtypes... args )
+                {
+                    std::shared_ptr<ifactory> factory = own_factory( new F( name_in, args... ) );
+                    entries.push_back( entry( std::type_index(typeid(I)), 
+                                interned_name( name_in ), factory ) );
+                }
+
+        public:
+            // Reserve space for a known number of registrations
+            void reserve( size_t count )
+            {
+                entries.reserve( count );
+            }
+
+            size_t size() const
+            {
+                return entries.size();
+            }
+
+            template<typename I, typename callable, typename ...argtypes>
+                void register_delegate_with_name( const std::string &name_in,
+                        callable call_obj )
+                {
+                    typedef delegate_factory<I, callable, argtypes...> 
+                        factorytype;
+                    add_with_name_template<factorytype, I, callable>( 
+                            name_in, call_obj );
+                }
+
+            template<typename I, typename callable, typename ...argtypes>
+                void register_delegate( callable call_obj )
+                {
+                    register_delegate_with_name<I, callable, argtypes...>( 
+                            unnamed_type_name_registration, call_obj );
+                }
+
+            template<typename I, typename T, typename ...argtypes>
+                void register_type_with_name( const std::string &name_in )
+                {
+                    add_with_name_template<resolvable_factory, I, 
+                        const construction *>( name_in,
+                            construction_of<I, T, argtypes...>() );
+                }
+
+            template<typename I, typename T, typename ...argtypes>
+                void register_type()
+                {
+                    register_type_with_name<I, T, argtypes...>( 
+                            unnamed_type_name_registration );
+                }
+
+            template<typename I, typename T, typename ...argtypes>
+                void register_singleton_with_name( const std::string &name_in )
+                {
+                    add_with_name_template<container::singleton_factory, I,
+                        const construction *>( name_in,
+                            construction_of<I, T, argtypes...>() );
+                }
+
+            template<typename I, typename T, typename ...argtypes>
+                void register_singleton()
+                {
+                    register_singleton_with_name<I, T, argtypes...>( 
+                            unnamed_type_name_registration );
+                }
+
+            template<typename I>
+                void register_instance_with_name( const std::string &name_in,
+                        std::shared_ptr<I> instance_in )
+                {
+                    add_with_name_template<instance_factory<I>, I, 
+                        std::shared_ptr<I>>( name_in, instance_in );
+                }
+
+            template<typename I>
+                void register_instance( std::shared_ptr<I> instance_in )
+                {
+                    register_instance_with_name<I>( 
+                            unnamed_type_name_registration, instance_in );
+                }
+    };
 };
-#endif // IOC_H
 
+// Explicit instantiation hooks. Declaring registrations and resolves
+// extern in a header shared by many wiring files stops each of them
+// instantiating the factories involved. A single translation unit
+// then instantiates them. A registration is named by its interface
+// followed by the template arguments given to register_type after
+// it, the implementation and any types it is constructed from.
+// Arguments must not contain unparenthesised commas.
+#define IOC_EXTERN_REGISTRATION( I, ... ) \
+    extern template void ioc::container::register_type<I, __VA_ARGS__>(); \
+    extern template void ioc::container::register_type_with_name<I, __VA_ARGS__>( \
+            const std::string & )
+
+#define IOC_INSTANTIATE_REGISTRATION( I, ... ) \
+    template void ioc::container::register_type<I, __VA_ARGS__>(); \
+    template void ioc::container::register_type_with_name<I, __VA_ARGS__>( \
+            const std::string & )
+
+#define IOC_EXTERN_RESOLVE( I ) \
+    extern template std::shared_ptr<I> ioc::container::resolve<I>() const; \
+    extern template std::shared_ptr<I> ioc::container::resolve_by_name<I>( \
+            const std::string & ) const
+
+#define IOC_INSTANTIATE_RESOLVE( I ) \
+    template std::shared_ptr<I> ioc::container::resolve<I>() const; \
+    template std::shared_ptr<I> ioc::container::resolve_by_name<I>( \
+            const std::string & ) const
+
+// Declare G as the implementation template of the interface template
+// F, for register_generic. The declaration must be made in the
+// namespace of F so that it is found wherever an F<T> is resolved.
+#define IOC_GENERIC_IMPLEMENTATION( F, G ) \
+    template<typename ...ioc_generic_arguments> \
+    G<ioc_generic_arguments...> *ioc_generic_implementation( \
+            F<ioc_generic_arguments...> * )
+
+#if !defined(IOC_SEPARATE_COMPILATION)
+#include "ioc_impl.h"
+#endif
+#endif // IOC_H
@@ -0,0 +1,587 @@
+/*
+ * ioc_async.h - Coroutine based asynchronous resolution for
+ * the IOC container
+ *
+ * Copyright (c) 2012 Nicholas A. Smith (nickrmc83@gmail.com)
+ * Distributed under the Boost software license 1.0,
+ * see boost.org for a copy.
+ */
+
+
+#ifndef IOC_ASYNC_H
+#define IOC_ASYNC_H
+
+#include "ioc.h"
+
+#if !defined(__cpp_impl_coroutine)
+#error "ioc_async.h requires C++20 coroutine support e.g. -std=c++20"
+#endif
+
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace ioc
+{
+    // executor is the interface asynchronous resolution uses to
+    // run work. Users may supply their own to integrate with an
+    // existing event loop or thread pool.
+    class executor
+    {
+        public:
+            virtual ~executor(){}
+            virtual void post( std::function<void()> work ) = 0;
+    };
+
+    // inline_executor runs work immediately on the posting thread.
+    class inline_executor : public executor
+    {
+        public:
+            void post( std::function<void()> work )
+            {
+                work();
+            }
+    };
+
+    // thread_pool runs work on a fixed number of worker threads.
+    // Outstanding work is completed before destruction returns.
+    class thread_pool : public executor
+    {
+        private:
+            std::mutex lock;
+            std::condition_variable ready;
+            std::deque<std::function<void()>> work_queue;
+            std::vector<std::thread> workers;
+            bool stopping;
+
+            void run()
+            {
+                for( ;; )
+                {
+                    std::function<void()> work;
+                    {
+                        std::unique_lock<std::mutex> guard( lock );
+                        ready.wait( guard, [this]()
+                                { return stopping || !work_queue.empty(); } );
+                        if( work_queue.empty() )
+                        {
+                            return;
+                        }
+                        work = std::move( work_queue.front() );
+                        work_queue.pop_front();
+                    }
+                    work();
+                }
+            }
+
+        public:
+            explicit thread_pool( size_t thread_count )
+                : stopping( false )
+            {
+                for( size_t i = 0; i < thread_count; ++i )
+                {
+                    workers.push_back( std::thread( &thread_pool::run, this ) );
+                }
+            }
+
+            ~thread_pool()
+            {
+                {
+                    std::lock_guard<std::mutex> guard( lock );
+                    stopping = true;
+                }
+                ready.notify_all();
+                for( size_t i = 0; i < workers.size(); ++i )
+                {
+                    workers[i].join();
+                }
+            }
+
+            void post( std::function<void()> work )
+            {
+                {
+                    std::lock_guard<std::mutex> guard( lock );
+                    work_queue.push_back( std::move( work ) );
+                }
+                ready.notify_one();
+            }
+    };
+
+    // task is a lazily started coroutine producing a single value.
+    // The coroutine begins when the task is awaited and resumes its
+    // awaiter when it completes.
+    template<typename T>
+        class task
+        {
+            public:
+                struct promise_type
+                {
+                    std::optional<T> value;
+                    std::exception_ptr error;
+                    std::coroutine_handle<> continuation;
+
+                    struct final_awaiter
+                    {
+                        bool await_ready() const noexcept
+                        {
+                            return false;
+                        }
+
+                        std::coroutine_handle<> await_suspend(
+                                std::coroutine_handle<promise_type> h ) noexcept
+                        {
+                            std::coroutine_handle<> next = h.promise().continuation;
+                            return next ? next : std::noop_coroutine();
+                        }
+
+                        void await_resume() const noexcept
+                        {
+                        }
+                    };
+
+                    task get_return_object()
+                    {
+                        return task( std::coroutine_handle<promise_type>
+                                ::from_promise( *this ) );
+                    }
+
+                    std::suspend_always initial_suspend() const noexcept
+                    {
+                        return std::suspend_always();
+                    }
+
+                    final_awaiter final_suspend() const noexcept
+                    {
+                        return final_awaiter();
+                    }
+
+                    void return_value( T value_in )
+                    {
+                        value.emplace( std::move( value_in ) );
+                    }
+
+                    void unhandled_exception()
+                    {
+                        error = std::current_exception();
+                    }
+                };
+
+            private:
+                std::coroutine_handle<promise_type> handle;
+
+                explicit task( std::coroutine_handle<promise_type> handle_in )
+                    : handle( handle_in )
+                {
+                }
+
+                struct awaiter
+                {
+                    std::coroutine_handle<promise_type> handle;
+
+                    bool await_ready() const noexcept
+                    {
+                        return false;
+                    }
+
+                    std::coroutine_handle<> await_suspend(
+                            std::coroutine_handle<> awaiting ) noexcept
+                    {
+                        handle.promise().continuation = awaiting;
+                        return handle;
+                    }
+
+                    T await_resume()
+                    {
+                        if( handle.promise().error )
+                        {
+                            std::rethrow_exception( handle.promise().error );
+                        }
+                        return std::move( *handle.promise().value );
+                    }
+                };
+
+            public:
+                task( task &&other ) noexcept : handle( other.handle )
+                {
+                    other.handle = nullptr;
+                }
+
+                task( const task & ) = delete;
+                task &operator=( const task & ) = delete;
+
+                ~task()
+                {
+                    if( handle )
+                    {
+                        handle.destroy();
+                    }
+                }
+
+                awaiter operator co_await() && noexcept
+                {
+                    return awaiter{ handle };
+                }
+        };
+
+    // Internal helpers for the asynchronous resolver.
+    namespace async_detail
+    {
+        // Eagerly started coroutine nobody waits on. Used to fan
+        // out the resolution of independent dependencies.
+        struct detached
+        {
+            struct promise_type
+            {
+                detached get_return_object() const noexcept
+                {
+                    return detached();
+                }
+
+                std::suspend_never initial_suspend() const noexcept
+                {
+                    return std::suspend_never();
+                }
+
+                std::suspend_never final_suspend() const noexcept
+                {
+                    return std::suspend_never();
+                }
+
+                void return_void() const noexcept
+                {
+                }
+
+                void unhandled_exception() const noexcept
+                {
+                    std::terminate();
+                }
+            };
+        };
+
+        // Awaiting a schedule_on moves the coroutine onto the
+        // given executor.
+        struct schedule_on
+        {
+            executor &exec;
+
+            bool await_ready() const noexcept
+            {
+                return false;
+            }
+
+            void await_suspend( std::coroutine_handle<> h ) const
+            {
+                exec.post( [h]() { h.resume(); } );
+            }
+
+            void await_resume() const noexcept
+            {
+            }
+        };
+
+        // Join point for a set of concurrently resolving
+        // dependencies. The awaiting coroutine holds one extra
+        // count so that it is resumed exactly once, either
+        // directly if all work finished before it suspended or by
+        // the last piece of work to arrive.
+        class join_state
+        {
+            private:
+                std::atomic<size_t> remaining;
+                std::coroutine_handle<> continuation;
+                std::mutex error_lock;
+                std::exception_ptr error;
+
+            public:
+                explicit join_state( size_t count ) : remaining( count + 1 )
+                {
+                }
+
+                void fail( std::exception_ptr error_in )
+                {
+                    std::lock_guard<std::mutex> guard( error_lock );
+                    if( !error )
+                    {
+                        error = error_in;
+                    }
+                }
+
+                void arrive()
+                {
+                    if( remaining.fetch_sub( 1, std::memory_order_acq_rel ) == 1 )
+                    {
+                        continuation.resume();
+                    }
+                }
+
+                // Returns true if the caller must stay suspended
+                bool arrive_and_suspend( std::coroutine_handle<> h )
+                {
+                    continuation = h;
+                    return remaining.fetch_sub( 1, std::memory_order_acq_rel ) != 1;
+                }
+
+                void rethrow_if_failed()
+                {
+                    if( error )
+                    {
+                        std::rethrow_exception( error );
+                    }
+                }
+        };
+
+        template<typename starter_type>
+            struct join_awaiter
+            {
+                join_state &state;
+                starter_type start;
+
+                bool await_ready() const noexcept
+                {
+                    return false;
+                }
+
+                bool await_suspend( std::coroutine_handle<> h )
+                {
+                    start();
+                    return state.arrive_and_suspend( h );
+                }
+
+                void await_resume()
+                {
+                    state.rethrow_if_failed();
+                }
+            };
+    }
+
+    template<typename I>
+        task<std::shared_ptr<I>> co_resolve( const container &resolver,
+                executor &exec );
+
+    template<typename I>
+        task<std::shared_ptr<I>> co_resolve_by_name( const container &resolver,
+                executor &exec, const std::string &name_in );
+
+    template<typename D>
+        async_detail::detached resolve_into( const container &resolver,
+                executor &exec, async_detail::join_state &state,
+                std::shared_ptr<D> &result )
+        {
+            try
+            {
+                co_await async_detail::schedule_on{ exec };
+                result = co_await co_resolve<D>( resolver, exec );
+            }
+            catch( ... )
+            {
+                state.fail( std::current_exception() );
+            }
+            state.arrive();
+        }
+
+    template<typename ...argtypes, size_t ...indices>
+        void start_all( const container &resolver, executor &exec,
+                async_detail::join_state &state,
+                std::tuple<std::shared_ptr<argtypes>...> &results,
+                std::index_sequence<indices...> )
+        {
+            ( resolve_into<argtypes>( resolver, exec, state,
+                                      std::get<indices>( results ) ), ... );
+        }
+
+    // Resolve every dependency concurrently on the executor and
+    // return them once all are available. If any dependency fails
+    // the first error is rethrown after all of them finished, any
+    // dependency already resolved is released.
+    template<typename ...argtypes>
+        task<std::tuple<std::shared_ptr<argtypes>...>>
+            co_resolve_all( const container &resolver, executor &exec )
+        {
+            typedef std::tuple<std::shared_ptr<argtypes>...> result_type;
+            result_type results;
+            async_detail::join_state state( sizeof...(argtypes) );
+
+            auto start = [&]()
+            {
+                start_all( resolver, exec, state, results,
+                        std::index_sequence_for<argtypes...>() );
+            };
+            co_await async_detail::join_awaiter<decltype(start)>{ state, start };
+            co_return std::move( results );
+        }
+
+    // Run a task to completion on the calling thread.
+    template<typename T>
+        T sync_wait( task<T> work )
+        {
+            std::mutex lock;
+            std::condition_variable ready;
+            bool done = false;
+            std::optional<T> value;
+            std::exception_ptr error;
+
+            auto run = [&]() -> async_detail::detached
+            {
+                try
+                {
+                    value.emplace( co_await std::move( work ) );
+                }
+                catch( ... )
+                {
+                    error = std::current_exception();
+                }
+                // Notify while holding the lock as the waiter owns
+                // the condition variable.
+                std::lock_guard<std::mutex> guard( lock );
+                done = true;
+                ready.notify_all();
+            };
+            run();
+
+            std::unique_lock<std::mutex> guard( lock );
+            ready.wait( guard, [&]() { return done; } );
+            if( error )
+            {
+                std::rethrow_exception( error );
+            }
+            return std::move( *value );
+        }
+
+    // async_factory extends base_factory with asynchronous item
+    // creation. Synchronous resolution of an asynchronous
+    // registration blocks until the item is available.
+    template<typename I>
+        class async_factory : public base_factory<I>
+        {
+            private:
+                I *internal_create_item( const container &resolver ) const
+                {
+                    inline_executor exec;
+                    return sync_wait( create_item_async( resolver, exec ) );
+                }
+
+            public:
+                async_factory( const std::string &name_in )
+                    : base_factory<I>( name_in )
+                {
+                }
+
+                virtual task<I *> create_item_async( const container &resolver,
+                        executor &exec ) const = 0;
+        };
+
+    // async_delegate_factory calls a delegate returning an awaitable
+    // which produces an I *. All delegate arguments are resolved
+    // concurrently before the delegate is called.
+    template<typename I, typename callable, typename ...argtypes>
+        class async_delegate_factory : public async_factory<I>
+        {
+            private:
+                callable callable_obj;
+
+            public:
+                async_delegate_factory( const std::string &name_in,
+                        const callable &callable_obj_in )
+                    : async_factory<I>( name_in ), callable_obj( callable_obj_in )
+                {
+                }
+
+                size_t footprint() const
+                {
+                    return sizeof(*this);
+                }
+
+                task<I *> create_item_async( const container &resolver,
+                        executor &exec ) const
+                {
+                    std::tuple<std::shared_ptr<argtypes>...> args =
+                        co_await co_resolve_all<argtypes...>( resolver, exec );
+                    // The delegate is called on the member so that any
+                    // state captured by it outlives the returned awaitable.
+                    I *result = co_await std::apply( callable_obj, std::move( args ) );
+                    co_return result;
+                }
+        };
+
+    namespace async_detail
+    {
+        template<typename I>
+            task<std::shared_ptr<I>> create( const container &resolver,
+                    executor &exec, std::shared_ptr<const ifactory> factory )
+            {
+                // The coroutine frame owns the factory so a registration
+                // replaced while it is suspended stays alive until done
+                const async_factory<I> *async =
+                    dynamic_cast<const async_factory<I> *>( factory.get() );
+                if( !async )
+                {
+                    // Synchronous registrations are created in place,
+                    // their own dependencies resolve synchronously.
+                    co_return std::static_pointer_cast<I>( factory->create_any( resolver ) );
+                }
+                I *result = co_await async->create_item_async( resolver, exec );
+                co_return std::shared_ptr<I>( result );
+            }
+    }
+
+    // Resolve interface type asynchronously. Dependencies of
+    // asynchronous registrations are resolved concurrently on the
+    // executor. If the interface is not registered return NULL.
+    template<typename I>
+        task<std::shared_ptr<I>> co_resolve( const container &resolver,
+                executor &exec )
+        {
+            std::shared_ptr<const ifactory> factory = 
+                resolver.share_factory<I>();
+            if( !factory )
+            {
+                co_return std::shared_ptr<I>();
+            }
+            co_return co_await async_detail::create<I>( resolver, exec, 
+                    std::move( factory ) );
+        }
+
+    // Resolve interface type by name asynchronously. If that fails
+    // then return NULL.
+    template<typename I>
+        task<std::shared_ptr<I>> co_resolve_by_name( const container &resolver,
+                executor &exec, const std::string &name_in )
+        {
+            std::shared_ptr<const ifactory> factory =
+                resolver.share_factory_by_name<I>( name_in );
+            if( !factory )
+            {
+                co_return std::shared_ptr<I>();
+            }
+            co_return co_await async_detail::create<I>( resolver, exec, 
+                    std::move( factory ) );
+        }
+
+    template<typename I, typename callable, typename ...argtypes>
+        void register_async_delegate_with_name( container &container_in,
+                const std::string &name_in, callable call_obj )
+        {
+            typedef async_delegate_factory<I, callable, argtypes...> factorytype;
+            container_in.register_factory_with_name<I>( name_in,
+                    std::shared_ptr<base_factory<I>>(
+                        new factorytype( name_in, call_obj ) ) );
+        }
+
+    template<typename I, typename callable, typename ...argtypes>
+        void register_async_delegate( container &container_in,
+                callable call_obj )
+        {
+            register_async_delegate_with_name<I, callable, argtypes...>(
+                    container_in, unnamed_type_name_registration, call_obj );
+        }
+};
+#endif // IOC_ASYNC_H
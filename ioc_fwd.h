@@ -0,0 +1,43 @@
+/*
+ * ioc_fwd.h - Forward declarations for the IOC container. Headers
+ * which only pass containers around can include this rather than
+ * ioc.h.
+ *
+ * Copyright (c) 2012 Nicholas A. Smith (nickrmc83@gmail.com)
+ * Distributed under the Boost software license 1.0,
+ * see boost.org for a copy.
+ */
+
+
+#ifndef IOC_FWD_H
+#define IOC_FWD_H
+
+namespace ioc
+{
+    template<typename unused>
+        class basic_container;
+    typedef basic_container<void> container;
+    class ifactory;
+    template<typename I>
+        class base_factory;
+    class registration_batch;
+    class resolved_item;
+    struct memory_report;
+    template<typename unused>
+        class basic_resolve_tracer;
+    typedef basic_resolve_tracer<void> resolve_tracer;
+    class dependency_bindings;
+    template<typename unused>
+        class basic_reclamation_queue;
+    typedef basic_reclamation_queue<void> reclamation_queue;
+    class registration_exception;
+    class resolution_exception;
+
+    template<typename ...argtypes>
+        struct dependencies;
+    template<typename A>
+        struct by_value;
+    template<typename A>
+        struct argument;
+};
+#endif // IOC_FWD_H
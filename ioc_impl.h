@@ -0,0 +1,2608 @@
+/*
+ * ioc_impl.h - The non-template core of the IOC container. Included
+ * by ioc.h unless IOC_SEPARATE_COMPILATION is defined, in which case
+ * it is compiled once by ioc.cpp.
+ *
+ * Copyright (c) 2012 Nicholas A. Smith (nickrmc83@gmail.com)
+ * Distributed under the Boost software license 1.0,
+ * see boost.org for a copy.
+ */
+
+
+#ifndef IOC_IMPL_H
+#define IOC_IMPL_H
+
+#include "ioc.h"
+
+#include <ostream>
+#include <iomanip>
+#include <thread>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <set>
+#include <functional>
+#include <unordered_set>
+#include <cstdint>
+#if defined(__GNUG__)
+#include <cxxabi.h>
+#endif
+
+namespace ioc
+{
+    // background_worker runs jobs in order on a single thread which is
+    // started with the first job. Jobs still queued when the worker is
+    // stopped are dropped.
+    template<typename unused>
+    class basic_container<unused>::background_worker
+    {
+        private:
+            std::mutex lock;
+            std::condition_variable wake;
+            std::deque<std::function<void()>> jobs;
+            std::thread runner;
+            bool stopping;
+
+            background_worker( const background_worker & );
+            background_worker &operator=( const background_worker & );
+
+            void run();
+
+        public:
+            background_worker() : stopping( false )
+            {
+            }
+
+            ~background_worker()
+            {
+                stop();
+            }
+
+            void post( const std::function<void()> &job );
+
+            // Wait for the running job, if any, and drop the rest
+            void stop();
+    };
+
+    // One thread's cache of the shared items it resolved from one
+    // container, keyed by interface type. Each entry owns a reference
+    // to the item through its own control block, so copying a cached
+    // pointer only touches memory local to the thread. Only the thread
+    // uses the entries while resolving. The lock is taken when they are
+    // released on its behalf, by the container's destructor or when
+    // the thread exits.
+    template<typename unused>
+    struct basic_container<unused>::thread_cache_slot
+    {
+        // Deleter which releases the original owner of an item
+        struct retain_deleter
+        {
+            std::shared_ptr<void> item;
+
+            void operator()( void * )
+            {
+                item.reset();
+            }
+        };
+
+        typedef std::unordered_map<const std::type_info *, std::shared_ptr<void>> 
+            entry_map;
+
+        std::mutex lock;
+        unsigned long long generation;
+        entry_map entries;
+        // Set once the thread has exited or the container has gone
+        bool abandoned;
+        bool retired;
+
+        thread_cache_slot() : generation( 0 ), abandoned( false ), retired( false )
+        {
+        }
+
+        // Returns NULL on a miss. Entries cached before the container's
+        // generation moved on are dropped first.
+        const std::shared_ptr<void> *find( unsigned long long current, 
+                const std::type_info &type )
+        {
+            if( generation != current )
+            {
+                entries.clear();
+                generation = current;
+                return NULL;
+            }
+            entry_map::const_iterator i = entries.find( &type );
+            return i != entries.end() ? &i->second : NULL;
+        }
+
+        // Store an item resolved since the last call to find. If the
+        // generation moved on in the meantime the entry is dropped on
+        // the next find.
+        void store( const std::type_info &type, const std::shared_ptr<void> &item )
+        {
+            retain_deleter retain = { item };
+            entries[&type] = std::shared_ptr<void>( item.get(), retain );
+        }
+
+        // Release the entries once the thread has exited, or once the
+        // container has gone
+        void release( bool thread_exited )
+        {
+            entry_map released;
+            std::lock_guard<std::mutex> guard( lock );
+            ( thread_exited ? abandoned : retired ) = true;
+            released.swap( entries );
+        }
+    };
+
+    // The thread cache slots of the calling thread by container id.
+    // Slots of destroyed containers are dropped as new ones are added.
+    template<typename unused>
+    class basic_container<unused>::thread_resolve_cache
+    {
+        private:
+            typedef std::shared_ptr<thread_cache_slot> slot_ptr;
+            typedef std::unordered_map<unsigned long long, slot_ptr> slot_map;
+
+            unsigned long long last_owner;
+            thread_cache_slot *last;
+            slot_map slots;
+
+            thread_resolve_cache() : last_owner( 0 ), last( NULL )
+            {
+            }
+
+            // Release everything the thread cached
+            ~thread_resolve_cache()
+            {
+                for( typename slot_map::iterator i = slots.begin(); i != slots.end(); ++i )
+                {
+                    i->second->release( true );
+                }
+            }
+
+        public:
+            static thread_resolve_cache &local()
+            {
+                static thread_local thread_resolve_cache cache;
+                return cache;
+            }
+
+            // The slot for a container, NULL if the thread has none
+            thread_cache_slot *find( unsigned long long owner )
+            {
+                if( owner == last_owner )
+                {
+                    return last;
+                }
+                typename slot_map::const_iterator i = slots.find( owner );
+                if( i == slots.end() )
+                {
+                    return NULL;
+                }
+                last_owner = owner;
+                last = i->second.get();
+                return last;
+            }
+
+            void add( unsigned long long owner, const slot_ptr &slot )
+            {
+                for( typename slot_map::iterator i = slots.begin(); i != slots.end(); )
+                {
+                    bool retired = false;
+                    {
+                        std::lock_guard<std::mutex> guard( i->second->lock );
+                        retired = i->second->retired;
+                    }
+                    if( retired )
+                    {
+                        i = slots.erase( i );
+                    }
+                    else
+                    {
+                        ++i;
+                    }
+                }
+                slots[owner] = slot;
+                last_owner = owner;
+                last = slot.get();
+            }
+
+            // Release the thread's entries, keeping its slots
+            void clear()
+            {
+                for( typename slot_map::iterator i = slots.begin(); i != slots.end(); ++i )
+                {
+                    typename thread_cache_slot::entry_map released;
+                    std::lock_guard<std::mutex> guard( i->second->lock );
+                    released.swap( i->second->entries );
+                }
+            }
+    };
+
+    IOC_DECL const runtime_arguments::value *runtime_arguments::find( 
+            const std::type_info &type )
+    {
+        for( const runtime_arguments *frame = current(); frame; frame = frame->previous )
+        {
+            for( size_t i = 0; i < frame->count; ++i )
+            {
+                if( *frame->values[i].type == type )
+                {
+                    return &frame->values[i];
+                }
+            }
+        }
+        return NULL;
+    }
+
+    IOC_DECL void runtime_arguments::missing( const std::type_info &type )
+    {
+        throw resolution_exception( type.name(), "No runtime argument" );
+    }
+
+    struct name_table::storage
+    {
+        struct entry_hash
+        {
+            size_t operator()( const entry &name ) const
+            {
+                return std::hash<std::string>()( name.text );
+            }
+        };
+
+        struct entry_equal
+        {
+            bool operator()( const entry &a, const entry &b ) const
+            {
+                return a.text == b.text;
+            }
+        };
+
+        // An entry is only erased, and only revived from no
+        // references, under the lock of its shard
+        struct shard
+        {
+            std::mutex lock;
+            std::unordered_set<entry, entry_hash, entry_equal> names;
+        };
+        static const size_t shard_count = 16;
+        shard shards[shard_count];
+        std::atomic<size_t> bytes;
+
+        storage() : bytes( 0 )
+        {
+        }
+    };
+
+    IOC_DECL name_table::storage &name_table::instance()
+    {
+        // Deliberately leaked, factories may outlive statics
+        static storage *table = new storage();
+        return *table;
+    }
+
+    IOC_DECL const name_table::entry *name_table::intern( const std::string &name )
+    {
+        storage &table = instance();
+        storage::shard &shard = 
+            table.shards[std::hash<std::string>()( name ) % storage::shard_count];
+        std::lock_guard<std::mutex> guard( shard.lock );
+        const std::pair<std::unordered_set<entry, storage::entry_hash, 
+            storage::entry_equal>::iterator, bool> result = shard.names.emplace( name );
+        if( result.second )
+        {
+            table.bytes.fetch_add( footprint( &result.first->text ), 
+                    std::memory_order_relaxed );
+        }
+        result.first->references.fetch_add( 1, std::memory_order_relaxed );
+        return &*result.first;
+    }
+
+    IOC_DECL void name_table::release( const entry *name )
+    {
+        // References other than the last are dropped without the lock
+        size_t references = name->references.load( std::memory_order_relaxed );
+        while( references > 1 )
+        {
+            if( name->references.compare_exchange_weak( references, references - 1,
+                        std::memory_order_release, std::memory_order_relaxed ) )
+            {
+                return;
+            }
+        }
+        storage &table = instance();
+        storage::shard &shard = table.shards[
+            std::hash<std::string>()( name->text ) % storage::shard_count];
+        std::lock_guard<std::mutex> guard( shard.lock );
+        if( name->references.fetch_sub( 1, std::memory_order_acq_rel ) == 1 )
+        {
+            table.bytes.fetch_sub( footprint( &name->text ), 
+                    std::memory_order_relaxed );
+            shard.names.erase( shard.names.find( *name ) );
+        }
+    }
+
+    IOC_DECL size_t name_table::usage()
+    {
+        return instance().bytes.load( std::memory_order_relaxed );
+    }
+
+    IOC_DECL size_t name_table::footprint( const std::string *name )
+    {
+        // Short names are held inline by the string itself
+        const char *data = name->data();
+        const bool inline_data = 
+            data >= reinterpret_cast<const char *>( name ) &&
+            data < reinterpret_cast<const char *>( name + 1 );
+        // Hash set nodes carry a next pointer, a cached hash and the
+        // reference count
+        return sizeof(entry) + 2 * sizeof(void *) +
+            ( inline_data ? 0 : name->capacity() + 1 );
+    }
+
+    // Storage requested for an item_block's item and where it was placed
+    struct item_storage
+    {
+        size_t size;
+        size_t alignment;
+        void *placed;
+    };
+
+    // Allocates an item_block's control block with room for its item
+    // behind it, in 'arena' if there is one.
+    template<typename U>
+        class item_block_allocator
+        {
+            public:
+                typedef U value_type;
+
+                graph_arena *arena;
+                item_storage *storage;
+
+                item_block_allocator( graph_arena *arena_in, item_storage *storage_in )
+                    : arena( arena_in ), storage( storage_in )
+                {
+                }
+
+                template<typename V>
+                    item_block_allocator( const item_block_allocator<V> &other )
+                    : arena( other.arena ), storage( other.storage )
+                    {
+                    }
+
+                template<typename V>
+                    struct rebind
+                    {
+                        typedef item_block_allocator<V> other;
+                    };
+
+                U *allocate( size_t count )
+                {
+                    const size_t head = count * sizeof(U);
+                    const size_t alignment = storage->alignment;
+                    // Over-aligned items are placed by hand so the block
+                    // itself never needs more than std::max_align_t
+                    const size_t slack = alignment > alignof(std::max_align_t) ?
+                        alignment - 1 : ( alignment - head % alignment ) % alignment;
+                    const size_t total = head + slack + storage->size;
+                    char *raw = static_cast<char *>( arena ?
+                            arena->allocate( total, alignof(std::max_align_t) ) :
+                            ::operator new( total ) );
+                    const size_t misplaced = 
+                        reinterpret_cast<std::uintptr_t>( raw + head ) % alignment;
+                    storage->placed = raw + head + 
+                        ( misplaced ? alignment - misplaced : 0 );
+                    return reinterpret_cast<U *>( raw );
+                }
+
+                void deallocate( U *p, size_t )
+                {
+                    if( arena )
+                    {
+                        arena->deallocate( p );
+                    }
+                    else
+                    {
+                        ::operator delete( p );
+                    }
+                }
+
+                template<typename V>
+                    bool operator==( const item_block_allocator<V> &other ) const
+                    {
+                        return arena == other.arena;
+                    }
+
+                template<typename V>
+                    bool operator!=( const item_block_allocator<V> &other ) const
+                    {
+                        return arena != other.arena;
+                    }
+        };
+
+    IOC_DECL std::shared_ptr<item_block> item_block::allocate( size_t size,
+            size_t alignment, void *&storage )
+    {
+        item_storage requested = { size, alignment, NULL };
+        const std::shared_ptr<item_block> block = std::allocate_shared<item_block>( 
+                item_block_allocator<item_block>( graph_arena::current(), &requested ) );
+        storage = requested.placed;
+        return block;
+    }
+
+    IOC_DECL std::shared_ptr<ifactory> ifactory::share( ifactory *factory )
+    {
+        return std::shared_ptr<ifactory>( factory );
+    }
+
+    IOC_DECL std::shared_ptr<void> item_block::share( 
+            const std::shared_ptr<item_block> &block, void *result )
+    {
+        return std::shared_ptr<void>( block, result );
+    }
+
+    IOC_DECL void construction_plan::bind( 
+            const std::shared_ptr<const dependency_bindings> &bindings )
+    {
+        std::shared_ptr<bound_arguments> arguments( new bound_arguments() );
+        arguments->bindings = bindings;
+        arguments->slots.reset( new const std::string *[recipe->arity] );
+        for( size_t i = 0; i < recipe->arity; ++i )
+        {
+            const std::type_info *type = recipe->bound_type( i );
+            arguments->slots[i] = type ? bindings->find( *type ) : NULL;
+        }
+        bound = arguments;
+    }
+
+    IOC_DECL resolvable_factory::resolvable_factory( const std::string &name_in, 
+            const construction *recipe_in )
+        : ifactory( interned_name( name_in ) ), plan( recipe_in )
+    {
+    }
+
+    IOC_DECL const std::type_info &resolvable_factory::get_type() const
+    {
+        return plan.type();
+    }
+
+    IOC_DECL void *resolvable_factory::create_item( const container &resolver ) const
+    {
+        return plan.create( *this, resolver );
+    }
+
+    IOC_DECL std::shared_ptr<void> resolvable_factory::create_any( 
+            const container &resolver ) const
+    {
+        return plan.create_shared( *this, resolver );
+    }
+
+    IOC_DECL std::shared_ptr<ifactory> resolvable_factory::clone() const
+    {
+        return ifactory::share( new resolvable_factory( *this ) );
+    }
+
+    IOC_DECL std::shared_ptr<ifactory> resolvable_factory::bind_dependencies(
+            const std::shared_ptr<const dependency_bindings> &bindings ) const
+    {
+        const std::shared_ptr<ifactory> copy = clone();
+        static_cast<resolvable_factory *>( copy.get() )->plan.bind( bindings );
+        return copy;
+    }
+
+    IOC_DECL size_t resolvable_factory::footprint() const
+    {
+        return sizeof(*this) + plan.footprint();
+    }
+
+    IOC_DECL std::shared_ptr<void> item_block::adopt( void *item_in, 
+            destroy_function destroy_in )
+    {
+        return std::shared_ptr<void>( item_in, destroy_in );
+    }
+
+    template<typename unused>
+    IOC_DECL void basic_epoch_domain<unused>::retire( const std::shared_ptr<void> &item )
+    {
+        {
+            std::lock_guard<std::mutex> guard( lock );
+            retired.push_back( retired_item( 
+                        epoch.fetch_add( 1, std::memory_order_seq_cst ), 
+                        item ) );
+        }
+        if( local().deferrals == 0 )
+        {
+            collect();
+        }
+    }
+
+    template<typename unused>
+    IOC_DECL void basic_epoch_domain<unused>::collect()
+    {
+        std::vector<std::shared_ptr<void>> released;
+        {
+            std::lock_guard<std::mutex> guard( lock );
+            unsigned long long oldest = epoch.load( std::memory_order_seq_cst );
+            for( size_t i = 0; i < records.size(); ++i )
+            {
+                const unsigned long long active = 
+                    records[i]->active.load( std::memory_order_seq_cst );
+                if( active != 0 && active < oldest )
+                {
+                    oldest = active;
+                }
+            }
+            size_t kept = 0;
+            for( size_t i = 0; i < retired.size(); ++i )
+            {
+                if( retired[i].first < oldest )
+                {
+                    released.push_back( retired[i].second );
+                }
+                else
+                {
+                    retired[kept++].swap( retired[i] );
+                }
+            }
+            retired.resize( kept );
+        }
+        // Destructors run outside of the lock as released is
+        // destroyed here.
+    }
+
+    // State shared with the worker and with the deleters of
+    // every outstanding item.
+    template<typename unused>
+    struct basic_reclamation_queue<unused>::state
+    {
+        std::atomic<node *> head;
+        std::atomic<size_t> pending;
+        std::atomic<bool> running;
+        const size_t batch_size;
+        const std::chrono::steady_clock::duration interval;
+
+        // Held while a list is being destroyed
+        std::mutex consumer_lock;
+        std::mutex wake_lock;
+        std::condition_variable wake;
+        std::thread reclaimer;
+
+        state( size_t batch_size_in, 
+                std::chrono::steady_clock::duration interval_in )
+            : head( NULL ), pending( 0 ), running( true ),
+            batch_size( batch_size_in ? batch_size_in : 1 ),
+            interval( interval_in )
+        {
+        }
+
+        // Anything queued while the queue was being drained
+        ~state()
+        {
+            reclaim();
+        }
+
+        void push( void *item, void (*destroy)( void * ) )
+        {
+            node *n = running.load( std::memory_order_acquire ) ?
+                new(std::nothrow) node() : NULL;
+            if( !n )
+            {
+                destroy( item );
+                return;
+            }
+            n->item = item;
+            n->destroy = destroy;
+            n->next = head.load( std::memory_order_relaxed );
+            while( !head.compare_exchange_weak( n->next, n, 
+                        std::memory_order_release, std::memory_order_relaxed ) )
+            {
+            }
+            if( pending.fetch_add( 1, std::memory_order_relaxed ) + 1 == 
+                    batch_size )
+            {
+                wake.notify_one();
+            }
+        }
+
+        // Destroy everything queued so far in the order queued
+        void reclaim()
+        {
+            std::lock_guard<std::mutex> guard( consumer_lock );
+            node *list = head.exchange( NULL, std::memory_order_acquire );
+            node *ordered = NULL;
+            while( list )
+            {
+                node *next = list->next;
+                list->next = ordered;
+                ordered = list;
+                list = next;
+            }
+            while( ordered )
+            {
+                node *next = ordered->next;
+                ordered->destroy( ordered->item );
+                delete ordered;
+                pending.fetch_sub( 1, std::memory_order_relaxed );
+                ordered = next;
+            }
+        }
+    };
+
+    template<typename unused>
+    IOC_DECL basic_reclamation_queue<unused>::basic_reclamation_queue( size_t batch_size,
+            std::chrono::steady_clock::duration interval )
+        : shared( new state( batch_size, interval ) )
+    {
+        shared->reclaimer = std::thread( worker, shared );
+    }
+
+    template<typename unused>
+    IOC_DECL basic_reclamation_queue<unused>::~basic_reclamation_queue()
+    {
+        drain();
+    }
+
+    // Ids are looked up without a lock in the current map, which is
+    // copied and republished when a type is first seen
+    template<typename unused>
+    struct basic_type_ids<unused>::storage
+    {
+        typedef std::unordered_map<std::type_index, size_t> id_map;
+
+        std::mutex lock;
+        std::atomic<const id_map *> current;
+        std::shared_ptr<id_map> owner;
+
+        storage() : current( NULL )
+        {
+        }
+    };
+
+    template<typename unused>
+    IOC_DECL typename basic_type_ids<unused>::storage &basic_type_ids<unused>::instance()
+    {
+        // Deliberately leaked, ids may be looked up after statics
+        static storage *ids = new storage();
+        return *ids;
+    }
+
+    template<typename unused>
+    IOC_DECL bool basic_type_ids<unused>::find( const std::type_index &type, size_t &id )
+    {
+        const typename storage::id_map *current = 
+            instance().current.load( std::memory_order_acquire );
+        if( current )
+        {
+            typename storage::id_map::const_iterator i = current->find( type );
+            if( i != current->end() )
+            {
+                id = i->second;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    template<typename unused>
+    IOC_DECL size_t basic_type_ids<unused>::of( const std::type_index &type )
+    {
+        size_t id = 0;
+        {
+            epoch_guard guard;
+            if( find( type, id ) )
+            {
+                return id;
+            }
+        }
+        storage &ids = instance();
+        retire_scope reclaim;
+        std::lock_guard<std::mutex> guard( ids.lock );
+        if( ids.owner )
+        {
+            typename storage::id_map::const_iterator i = ids.owner->find( type );
+            if( i != ids.owner->end() )
+            {
+                return i->second;
+            }
+        }
+        std::shared_ptr<typename storage::id_map> copied( ids.owner ? 
+                new typename storage::id_map( *ids.owner ) : 
+                new typename storage::id_map() );
+        id = copied->size();
+        copied->insert( std::make_pair( type, id ) );
+        if( ids.owner )
+        {
+            epoch_domain::instance().retire( ids.owner );
+        }
+        ids.owner = copied;
+        ids.current.store( copied.get(), std::memory_order_release );
+        return id;
+    }
+
+    template<typename unused>
+    IOC_DECL void
+        basic_reclamation_queue<unused>::push( const std::shared_ptr<state> &shared, 
+                void *item, void (*destroy)( void * ) )
+    {
+        shared->push( item, destroy );
+    }
+
+    template<typename unused>
+    IOC_DECL void basic_reclamation_queue<unused>::flush()
+    {
+        shared->reclaim();
+    }
+
+    template<typename unused>
+    IOC_DECL size_t basic_reclamation_queue<unused>::pending() const
+    {
+        return shared->pending.load( std::memory_order_relaxed );
+    }
+
+    template<typename unused>
+    IOC_DECL void basic_reclamation_queue<unused>::worker( std::shared_ptr<state> shared )
+    {
+        std::unique_lock<std::mutex> guard( shared->wake_lock );
+        while( shared->running.load( std::memory_order_acquire ) )
+        {
+            shared->wake.wait_for( guard, shared->interval );
+            guard.unlock();
+            shared->reclaim();
+            guard.lock();
+        }
+    }
+
+    template<typename unused>
+    IOC_DECL void basic_reclamation_queue<unused>::drain()
+    {
+        {
+            std::lock_guard<std::mutex> guard( shared->wake_lock );
+            shared->running.store( false, std::memory_order_release );
+        }
+        shared->wake.notify_one();
+        if( shared->reclaimer.joinable() )
+        {
+            if( shared->reclaimer.get_id() == std::this_thread::get_id() )
+            {
+                // Drained by an item the worker is destroying
+                shared->reclaimer.detach();
+            }
+            else
+            {
+                shared->reclaimer.join();
+            }
+        }
+        shared->reclaim();
+    }
+
+    template<typename unused>
+    IOC_DECL typename basic_resolve_tracer<unused>::thread_buffer &
+        basic_resolve_tracer<unused>::local_buffer()
+    {
+        typedef std::vector<std::pair<unsigned long long, buffer_ptr>> 
+            thread_buffers;
+        static thread_local thread_buffers local;
+        for( size_t i = 0; i < local.size(); ++i )
+        {
+            if( local[i].first == id )
+            {
+                return *local[i].second;
+            }
+        }
+        buffer_ptr buffer( new thread_buffer() );
+        {
+            std::lock_guard<std::mutex> guard( lock );
+            buffer->thread = buffers.size() + 1;
+            buffers.push_back( buffer );
+        }
+        local.push_back( std::make_pair( id, buffer ) );
+        return *buffer;
+    }
+
+    template<typename unused>
+    IOC_DECL std::string
+        basic_resolve_tracer<unused>::type_name( const std::type_info &type )
+    {
+#if defined(__GNUG__)
+        int status = 0;
+        char *demangled = abi::__cxa_demangle( type.name(), NULL, NULL, &status );
+        if( demangled )
+        {
+            std::string result( demangled );
+            free( demangled );
+            return result;
+        }
+#endif
+        return type.name();
+    }
+
+    template<typename unused>
+    IOC_DECL void
+        basic_resolve_tracer<unused>::write_string( std::ostream &out, 
+                const std::string &value )
+    {
+        static const char hex[] = "0123456789abcdef";
+        out << '"';
+        for( size_t i = 0; i < value.size(); ++i )
+        {
+            const unsigned char c = static_cast<unsigned char>( value[i] );
+            if( c == '"' || c == '\\' )
+            {
+                out << '\\' << value[i];
+            }
+            else if( c < 0x20 )
+            {
+                out << "\\u00" << hex[c >> 4] << hex[c & 0xf];
+            }
+            else
+            {
+                out << value[i];
+            }
+        }
+        out << '"';
+    }
+
+    template<typename unused>
+    IOC_DECL const char *basic_resolve_tracer<unused>::outcome_name( outcome result )
+    {
+        switch( result )
+        {
+            case cache_hit:
+                return "cache_hit";
+            case constructed:
+                return "constructed";
+            default:
+                return "failed";
+        }
+    }
+
+    template<typename unused>
+    IOC_DECL size_t basic_resolve_tracer<unused>::event_count() const
+    {
+        std::lock_guard<std::mutex> guard( lock );
+        size_t result = 0;
+        for( size_t i = 0; i < buffers.size(); ++i )
+        {
+            std::lock_guard<std::mutex> buffer_guard( buffers[i]->lock );
+            result += buffers[i]->events.size();
+        }
+        return result;
+    }
+
+    template<typename unused>
+    IOC_DECL void basic_resolve_tracer<unused>::clear()
+    {
+        std::lock_guard<std::mutex> guard( lock );
+        for( size_t i = 0; i < buffers.size(); ++i )
+        {
+            std::lock_guard<std::mutex> buffer_guard( buffers[i]->lock );
+            buffers[i]->events.clear();
+        }
+    }
+
+    template<typename unused>
+    IOC_DECL void
+        basic_resolve_tracer<unused>::write_chrome_trace( std::ostream &out ) const
+    {
+        std::lock_guard<std::mutex> guard( lock );
+        out << "{\"traceEvents\":[";
+        bool first = true;
+        for( size_t i = 0; i < buffers.size(); ++i )
+        {
+            std::lock_guard<std::mutex> buffer_guard( buffers[i]->lock );
+            const std::vector<event> &events = buffers[i]->events;
+            for( size_t j = 0; j < events.size(); ++j )
+            {
+                const event &e = events[j];
+                out << ( first ? "\n" : ",\n" ) << "{\"name\":";
+                first = false;
+                write_string( out, type_name( *e.type ) );
+                out << ",\"cat\":\"resolve\",\"ph\":\"" << ( e.begin ? 'B' : 'E' )
+                    << "\",\"ts\":" << e.time / 1000 << '.' 
+                    << std::setfill( '0' ) << std::setw( 3 ) << e.time % 1000
+                    << std::setfill( ' ' )
+                    << ",\"pid\":1,\"tid\":" << buffers[i]->thread;
+                if( !e.begin )
+                {
+                    out << ",\"args\":{\"outcome\":\"" << outcome_name( e.result ) << '"';
+                    if( e.name.get() )
+                    {
+                        out << ",\"registration\":";
+                        write_string( out, *e.name.get() );
+                    }
+                    out << '}';
+                }
+                out << '}';
+            }
+        }
+        out << "\n],\"displayTimeUnit\":\"ns\"}\n";
+    }
+
+    template<typename unused>
+    IOC_DECL void basic_container<unused>::background_worker::run()
+    {
+        std::unique_lock<std::mutex> guard( lock );
+        for( ;; )
+        {
+            while( !stopping && jobs.empty() )
+            {
+                wake.wait( guard );
+            }
+            if( stopping )
+            {
+                return;
+            }
+            std::function<void()> job;
+            job.swap( jobs.front() );
+            jobs.pop_front();
+            guard.unlock();
+            job();
+            job = std::function<void()>();
+            guard.lock();
+        }
+    }
+
+    template<typename unused>
+    IOC_DECL void
+        basic_container<unused>::background_worker::post( 
+                const std::function<void()> &job )
+    {
+        std::lock_guard<std::mutex> guard( lock );
+        if( stopping )
+        {
+            return;
+        }
+        jobs.push_back( job );
+        if( !runner.joinable() )
+        {
+            runner = std::thread( &background_worker::run, this );
+        }
+        wake.notify_one();
+    }
+
+    template<typename unused>
+    IOC_DECL void basic_container<unused>::background_worker::stop()
+    {
+        std::deque<std::function<void()>> dropped;
+        {
+            std::lock_guard<std::mutex> guard( lock );
+            stopping = true;
+            dropped.swap( jobs );
+        }
+        wake.notify_one();
+        if( runner.joinable() )
+        {
+            runner.join();
+        }
+    }
+
+    template<typename unused>
+    IOC_DECL std::shared_ptr<void>
+        basic_container<unused>::resolve_singleton( const ifactory *owner,
+                const construction_plan &plan ) const
+    {
+        slot_ptr slot = find_singleton_slot( owner );
+        if( !slot->ready.load( std::memory_order_acquire ) )
+        {
+            const construction_stack &stack = constructing();
+            for( size_t i = 0; i < stack.size(); ++i )
+            {
+                if( stack[i].second == slot.get() )
+                {
+                    throw resolution_exception( owner->get_type().name(),
+                            "Circular singleton dependency" );
+                }
+            }
+            std::lock_guard<std::mutex> guard( slot->lock );
+            if( !slot->ready.load( std::memory_order_relaxed ) )
+            {
+                construction_frame frame( this, slot.get() );
+                trace_scope::constructed();
+                // Singletons outlive any transient graph
+                graph_scope outside( NULL );
+                slot->item = plan.create_shared( *owner, *this );
+                slot->ready.store( true, std::memory_order_release );
+            }
+        }
+        const construction_stack &stack = constructing();
+        if( !stack.empty() && stack.back().first == this )
+        {
+            stack.back().second->dependencies.push_back( slot );
+        }
+        return slot->item;
+    }
+
+    // Work shared by the threads tearing down singletons. Each
+    // singleton is released once every singleton depending on it has
+    // been.
+    template<typename unused>
+    struct basic_container<unused>::teardown_state
+    {
+        std::mutex lock;
+        std::condition_variable changed;
+        std::vector<std::shared_ptr<void>> items;
+        std::vector<size_t> dependents;
+        std::vector<std::vector<size_t>> dependencies;
+        std::deque<size_t> ready;
+        size_t outstanding;
+        bool abandoned;
+    };
+
+    template<typename unused>
+    IOC_DECL unsigned basic_container<unused>::default_shards()
+    {
+        return std::thread::hardware_concurrency();
+    }
+
+    template<typename unused>
+    IOC_DECL std::shared_ptr<void>
+        basic_container<unused>::resolve_sharded( const ifactory *owner,
+                size_t shards, const construction_plan &plan ) const
+    {
+        replica &slot = find_replica( owner, shards );
+        if( !slot.ready.load( std::memory_order_acquire ) )
+        {
+            std::lock_guard<std::mutex> guard( slot.lock );
+            if( !slot.ready.load( std::memory_order_relaxed ) )
+            {
+                trace_scope::constructed();
+                // Replicas outlive any transient graph
+                graph_scope outside( NULL );
+                slot.item = plan.create_shared( *owner, *this );
+                slot.ready.store( true, std::memory_order_release );
+            }
+        }
+        return slot.item;
+    }
+
+    template<typename unused>
+    IOC_DECL void
+        basic_container<unused>::teardown_worker( std::shared_ptr<teardown_state> state )
+    {
+        std::unique_lock<std::mutex> guard( state->lock );
+        for( ;; )
+        {
+            state->changed.wait( guard, [&]()
+                    {
+                        return state->abandoned || 
+                            state->outstanding == 0 ||
+                            !state->ready.empty();
+                    } );
+            if( state->abandoned || state->outstanding == 0 )
+            {
+                return;
+            }
+            const size_t index = state->ready.front();
+            state->ready.pop_front();
+            std::shared_ptr<void> item;
+            item.swap( state->items[index] );
+            guard.unlock();
+            // Run the destructor outside of the lock
+            item.reset();
+            guard.lock();
+            --state->outstanding;
+            const std::vector<size_t> &next = state->dependencies[index];
+            for( size_t i = 0; i < next.size(); ++i )
+            {
+                if( --state->dependents[next[i]] == 0 )
+                {
+                    state->ready.push_back( next[i] );
+                }
+            }
+            state->changed.notify_all();
+        }
+    }
+
+    template<typename unused>
+    IOC_DECL void basic_container<unused>::teardown_singletons()
+    {
+        std::shared_ptr<teardown_state> state( new teardown_state() );
+        std::map<singleton_slot *, size_t> index;
+        std::vector<slot_ptr> slots;
+        for( typename singleton_slots::iterator i = singletons.begin(); 
+                i != singletons.end(); ++i )
+        {
+            if( i->second->ready.load( std::memory_order_acquire ) )
+            {
+                index[i->second.get()] = slots.size();
+                slots.push_back( i->second );
+            }
+        }
+        singletons.clear();
+        if( slots.empty() )
+        {
+            return;
+        }
+
+        state->items.resize( slots.size() );
+        state->dependents.resize( slots.size() );
+        state->dependencies.resize( slots.size() );
+        for( size_t i = 0; i < slots.size(); ++i )
+        {
+            state->items[i].swap( slots[i]->item );
+            for( size_t j = 0; j < slots[i]->dependencies.size(); ++j )
+            {
+                typename std::map<singleton_slot *, size_t>::const_iterator d = 
+                    index.find( slots[i]->dependencies[j].get() );
+                if( d != index.end() )
+                {
+                    state->dependencies[i].push_back( d->second );
+                    ++state->dependents[d->second];
+                }
+            }
+        }
+        slots.clear();
+        for( size_t i = 0; i < state->items.size(); ++i )
+        {
+            if( state->dependents[i] == 0 )
+            {
+                state->ready.push_back( i );
+            }
+        }
+        state->outstanding = state->items.size();
+        state->abandoned = false;
+
+        const bool bounded = 
+            teardown_deadline != std::chrono::steady_clock::duration::zero();
+        if( teardown_concurrency <= 1 && !bounded )
+        {
+            teardown_worker( state );
+            return;
+        }
+
+        // With a deadline the calling thread only waits, it must
+        // not be caught in a long running destructor itself.
+        const unsigned helpers = bounded ? 
+            std::max( 1u, teardown_concurrency ) : teardown_concurrency - 1;
+        std::vector<std::thread> workers;
+        for( unsigned i = 0; i < helpers; ++i )
+        {
+            workers.push_back( std::thread( &basic_container::teardown_worker, state ) );
+        }
+        if( !bounded )
+        {
+            teardown_worker( state );
+        }
+        else
+        {
+            std::unique_lock<std::mutex> guard( state->lock );
+            const bool finished = state->changed.wait_for( guard, 
+                    teardown_deadline, 
+                    [&]() { return state->outstanding == 0; } );
+            if( !finished )
+            {
+                // Leak what is left, destructors already running
+                // finish on their detached threads.
+                state->abandoned = true;
+                for( size_t i = 0; i < state->items.size(); ++i )
+                {
+                    if( state->items[i] )
+                    {
+                        new std::shared_ptr<void>( state->items[i] );
+                        state->items[i].reset();
+                    }
+                }
+                state->changed.notify_all();
+                guard.unlock();
+                for( size_t i = 0; i < workers.size(); ++i )
+                {
+                    workers[i].detach();
+                }
+                return;
+            }
+        }
+        for( size_t i = 0; i < workers.size(); ++i )
+        {
+            workers[i].join();
+        }
+    }
+
+    template<typename unused>
+    IOC_DECL const typename basic_container<unused>::dispatch_table &
+        basic_container<unused>::current_dispatch() const
+    {
+        const dispatch_table *table = dispatch.load( std::memory_order_acquire );
+        if( table && table->generation == generation.load( std::memory_order_seq_cst ) )
+        {
+            return *table;
+        }
+
+        retire_scope reclaim;
+        std::lock_guard<std::mutex> dispatch_guard( dispatch_lock );
+        std::lock_guard<std::mutex> guard( registration_lock );
+        std::shared_ptr<dispatch_table> rebuilt( new dispatch_table() );
+        rebuilt->generation = generation.load( std::memory_order_seq_cst );
+        for( const registry *l = &layer; l; l = l->base.get() )
+        {
+            for( typename registration_types::const_iterator i = l->types.begin();
+                    i != l->types.end(); ++i )
+            {
+                const size_t type_id = type_ids::of( i->first );
+                if( type_id >= rebuilt->types.size() )
+                {
+                    rebuilt->types.resize( type_id + 1 );
+                }
+                if( !rebuilt->types[type_id] )
+                {
+                    rebuilt->types[type_id] = resolve_factory( i->first );
+                }
+            }
+        }
+        rebuilt->keys.reserve( key_bindings.size() );
+        for( size_t i = 0; i < key_bindings.size(); ++i )
+        {
+            const key_binding &binding = key_bindings[i];
+            rebuilt->keys.push_back( !binding.type ? NULL : binding.name.get() ?
+                    resolve_factory_by_name( *binding.type, *binding.name.get() ) :
+                    resolve_factory( *binding.type ) );
+        }
+        if( dispatch_owner )
+        {
+            epoch_domain::instance().retire( dispatch_owner );
+        }
+        dispatch_owner = rebuilt;
+        dispatch.store( rebuilt.get(), std::memory_order_release );
+        return *rebuilt;
+    }
+
+    template<typename unused>
+    IOC_DECL void
+        basic_container<unused>::bind_key_to( size_t key, const std::type_info &type, 
+                const interned_name &name_in )
+    {
+        std::lock_guard<std::mutex> guard( registration_lock );
+        if( key >= key_bindings.size() )
+        {
+            const key_binding unbound = { NULL, interned_name() };
+            key_bindings.resize( key + 1, unbound );
+        }
+        key_bindings[key].type = &type;
+        key_bindings[key].name = name_in;
+        registration_changed();
+    }
+
+    template<typename unused>
+    IOC_DECL void basic_container<unused>::release_state( const ifactory *factory,
+            std::vector<std::shared_ptr<void>> &retired )
+    {
+        {
+            std::lock_guard<std::mutex> guard( singleton_lock );
+            typename singleton_slots::iterator i = singletons.find( factory );
+            if( i != singletons.end() )
+            {
+                retired.push_back( i->second );
+                singletons.erase( i );
+            }
+        }
+        {
+            std::lock_guard<std::mutex> guard( cache_lock );
+            typename std::map<const ifactory *, cache_ptr>::iterator i = 
+                caches.find( factory );
+            if( i != caches.end() )
+            {
+                retired.push_back( i->second );
+                caches.erase( i );
+            }
+        }
+        {
+            std::lock_guard<std::mutex> guard( replica_lock );
+            typename std::map<const ifactory *, replica_ptr>::iterator i =
+                replica_sets.find( factory );
+            if( i != replica_sets.end() )
+            {
+                retired.push_back( i->second );
+                replica_sets.erase( i );
+            }
+        }
+        std::lock_guard<std::mutex> guard( pool_lock );
+        typename std::map<const ifactory *, pool_ptr>::iterator i = pools.find( factory );
+        if( i != pools.end() )
+        {
+            retired.push_back( i->second );
+            pools.erase( i );
+        }
+    }
+
+    template<typename unused>
+    IOC_DECL void
+        basic_container<unused>::publish( registration_slot &slot, 
+                const factory_ptr &factory )
+    {
+        factory_ptr previous = slot.owner;
+        slot.owner = factory;
+        slot.current.store( factory.get(), std::memory_order_seq_cst );
+        if( previous )
+        {
+            // Decorating a factory keeps the state of the factory
+            // it wraps, such as its singleton
+            const ifactory *kept = factory ? factory->undecorated() : NULL;
+            const ifactory *inner = previous->undecorated();
+            std::vector<std::shared_ptr<void>> retired;
+            if( previous.get() != kept )
+            {
+                release_state( previous.get(), retired );
+            }
+            if( inner != previous.get() && inner != kept )
+            {
+                release_state( inner, retired );
+            }
+            // Invalidate dispatch tables and cached replicas and pools
+            // before the factory can go
+            registration_changed();
+            epoch_domain::instance().retire( previous );
+            for( size_t i = 0; i < retired.size(); ++i )
+            {
+                epoch_domain::instance().retire( retired[i] );
+            }
+            return;
+        }
+        registration_changed();
+    }
+
+    template<typename unused>
+    IOC_DECL void basic_container<unused>::queue_refill( const pool_ptr &pool ) const
+    {
+        refresher->post( std::bind( &basic_container::refill_pool, pool ) );
+    }
+
+    template<typename unused>
+    struct basic_container<unused>::cache_entry
+    {
+        std::shared_ptr<void> item;
+        std::chrono::steady_clock::time_point created;
+        bool refreshing;
+        // The last failed refresh, rethrown by the next resolve
+        std::exception_ptr failure;
+        std::list<std::string>::iterator position;
+    };
+
+    // Entries are ordered from most to least recently used
+    template<typename unused>
+    struct basic_container<unused>::cache_slot
+    {
+        std::mutex lock;
+        std::unordered_map<std::string, cache_entry> entries;
+        std::list<std::string> order;
+    };
+
+    template<typename unused>
+    IOC_DECL typename basic_container<unused>::cache_ptr
+        basic_container<unused>::find_cache( const ifactory *owner ) const
+    {
+        std::lock_guard<std::mutex> guard( cache_lock );
+        cache_ptr &result = caches[owner];
+        if( !result )
+        {
+            result.reset( new cache_slot() );
+        }
+        return result;
+    }
+
+    // Return the cached item for a key, creating it if there is none.
+    // Items older than the ttl are still returned while a replacement
+    // is created in the background. A failed refresh is thrown by the
+    // next resolve of its key. Least recently used keys are evicted
+    // beyond the capacity.
+    template<typename unused>
+    IOC_DECL std::shared_ptr<void>
+        basic_container<unused>::resolve_cached( const ifactory *owner,
+                const std::string &key, std::chrono::steady_clock::duration ttl, 
+                size_t capacity, const item_builder &create ) const
+    {
+        const cache_ptr cache = find_cache( owner );
+        {
+            std::exception_ptr failure;
+            {
+                std::lock_guard<std::mutex> guard( cache->lock );
+                typename std::unordered_map<std::string, cache_entry>::iterator i = 
+                    cache->entries.find( key );
+                if( i != cache->entries.end() )
+                {
+                    cache_entry &entry = i->second;
+                    cache->order.splice( cache->order.begin(), cache->order, 
+                            entry.position );
+                    failure.swap( entry.failure );
+                    if( !failure )
+                    {
+                        if( ttl != std::chrono::steady_clock::duration::zero() && 
+                                !entry.refreshing && 
+                                std::chrono::steady_clock::now() - entry.created >= ttl )
+                        {
+                            entry.refreshing = true;
+                            refresher->post( std::bind( &basic_container::refresh_cached, 
+                                        cache, key, create ) );
+                        }
+                        return entry.item;
+                    }
+                }
+            }
+            if( failure )
+            {
+                // The stale item stays cached and is refreshed again by
+                // a later resolve
+                std::rethrow_exception( failure );
+            }
+        }
+
+        // Created unlocked as the item may resolve other keys
+        trace_scope::constructed();
+        std::shared_ptr<void> item;
+        {
+            // Cached items outlive any transient graph
+            graph_scope outside( NULL );
+            item = create();
+        }
+        std::shared_ptr<void> evicted;
+        std::lock_guard<std::mutex> guard( cache->lock );
+        typename std::unordered_map<std::string, cache_entry>::iterator i = 
+            cache->entries.find( key );
+        if( i != cache->entries.end() )
+        {
+            // Another resolve created the item first
+            return i->second.item;
+        }
+        cache->order.push_front( key );
+        cache_entry &entry = cache->entries[key];
+        entry.item = item;
+        entry.created = std::chrono::steady_clock::now();
+        entry.refreshing = false;
+        entry.position = cache->order.begin();
+        if( capacity && cache->entries.size() > capacity )
+        {
+            i = cache->entries.find( cache->order.back() );
+            evicted.swap( i->second.item );
+            cache->entries.erase( i );
+            cache->order.pop_back();
+        }
+        return item;
+    }
+
+    // Replace a cached item. A failed refresh keeps the stale item and
+    // records the failure for the next resolve of the key.
+    template<typename unused>
+    IOC_DECL void basic_container<unused>::refresh_cached( const cache_ptr &cache, 
+            const std::string &key, const item_builder &create )
+    {
+        std::shared_ptr<void> item;
+        std::exception_ptr failure;
+        try
+        {
+            std::lock_guard<std::mutex> quiet( create.resolver->background_lock );
+            item = create();
+        }
+        catch( ... )
+        {
+            failure = std::current_exception();
+        }
+        std::lock_guard<std::mutex> guard( cache->lock );
+        typename std::unordered_map<std::string, cache_entry>::iterator i = 
+            cache->entries.find( key );
+        if( i == cache->entries.end() )
+        {
+            // Evicted while refreshing
+            return;
+        }
+        i->second.refreshing = false;
+        i->second.failure = failure;
+        if( item )
+        {
+            // The stale item is released by the caller's copy
+            item.swap( i->second.item );
+            i->second.created = std::chrono::steady_clock::now();
+        }
+    }
+
+    template<typename unused>
+    IOC_DECL void basic_container<unused>::refill_pool( const pool_ptr &pool )
+    {
+        for( ;; )
+        {
+            bool failed = false;
+            while( pool->ready.size() < pool->high )
+            {
+                // Released after the lock, an item the queue turns down
+                // may change registrations as it is destroyed
+                std::shared_ptr<void> item;
+                try
+                {
+                    std::lock_guard<std::mutex> quiet( 
+                            pool->create.resolver->background_lock );
+                    item = pool->create();
+                }
+                catch( ... )
+                {
+                    std::lock_guard<std::mutex> guard( pool->failure_lock );
+                    pool->failure = std::current_exception();
+                    pool->failed.store( true, std::memory_order_release );
+                }
+                if( !item || !pool->ready.push( item ) )
+                {
+                    failed = !item;
+                    break;
+                }
+            }
+            pool->refilling.store( false, std::memory_order_release );
+            // Resolves may have drained the pool while it was refilled
+            if( failed || pool->ready.size() >= pool->low ||
+                    pool->refilling.exchange( true, std::memory_order_acq_rel ) )
+            {
+                return;
+            }
+        }
+    }
+
+    template<typename unused>
+    IOC_DECL void basic_container<unused>::rethrow_failure( ready_pool &pool )
+    {
+        std::exception_ptr failure;
+        {
+            std::lock_guard<std::mutex> guard( pool.failure_lock );
+            failure.swap( pool.failure );
+            pool.failed.store( false, std::memory_order_relaxed );
+        }
+        if( failure )
+        {
+            std::rethrow_exception( failure );
+        }
+    }
+
+    template<typename unused>
+    IOC_DECL typename basic_container<unused>::ready_pool &
+        basic_container<unused>::find_pool( 
+                const pooled_factory &factory ) const
+    {
+        static thread_local std::vector<pool_cache_entry> recent;
+        const ifactory *owner = &factory;
+        const unsigned long long generation =
+            this->generation.load( std::memory_order_seq_cst );
+        typename std::vector<pool_cache_entry>::iterator i = recent.begin();
+        for( ; i != recent.end(); ++i )
+        {
+            if( i->container_id == id && i->owner == owner )
+            {
+                if( i->generation == generation )
+                {
+                    return *i->pool;
+                }
+                break;
+            }
+        }
+
+        pool_ptr pool;
+        bool created = false;
+        {
+            std::lock_guard<std::mutex> guard( pool_lock );
+            pool_ptr &result = pools[owner];
+            if( !result )
+            {
+                result.reset( new ready_pool( factory.low_watermark(),
+                            factory.high_watermark(), factory.creator( *this ) ) );
+                created = true;
+            }
+            pool = result;
+        }
+        if( created )
+        {
+            refill( *pool );
+        }
+        if( i == recent.end() )
+        {
+            // Entries for destroyed containers are never matched
+            if( recent.size() >= 32 )
+            {
+                recent.clear();
+            }
+            pool_cache_entry entry = { id, owner, generation, pool.get() };
+            recent.push_back( entry );
+        }
+        else
+        {
+            i->generation = generation;
+            i->pool = pool.get();
+        }
+        return *pool;
+    }
+
+    template<typename unused>
+    IOC_DECL std::shared_ptr<void> basic_container<unused>::resolve_pooled( 
+            const pooled_factory &factory, const construction_plan &plan ) const
+    {
+        ready_pool &pool = find_pool( factory );
+        if( pool.failed.load( std::memory_order_acquire ) )
+        {
+            rethrow_failure( pool );
+        }
+        std::shared_ptr<void> item;
+        if( pool.ready.pop( item ) )
+        {
+            pool.hits.fetch_add( 1, std::memory_order_relaxed );
+        }
+        else
+        {
+            pool.misses.fetch_add( 1, std::memory_order_relaxed );
+        }
+        if( pool.ready.size() < pool.low )
+        {
+            refill( pool );
+        }
+        if( item )
+        {
+            return item;
+        }
+        trace_scope::constructed();
+        return plan.create_shared( factory, *this );
+    }
+
+    template<typename unused>
+    IOC_DECL pool_statistics
+        basic_container<unused>::pool_usage( const ifactory *owner ) const
+    {
+        pool_statistics result;
+        std::lock_guard<std::mutex> guard( pool_lock );
+        typename std::map<const ifactory *, pool_ptr>::const_iterator i = 
+            pools.find( owner );
+        if( i != pools.end() )
+        {
+            const ready_pool &pool = *i->second;
+            result.low_watermark = pool.low;
+            result.high_watermark = pool.high;
+            result.ready = pool.ready.size();
+            result.hits = pool.hits.load( std::memory_order_relaxed );
+            result.misses = pool.misses.load( std::memory_order_relaxed );
+        }
+        return result;
+    }
+
+    template<typename unused>
+    IOC_DECL void basic_container<unused>::add_factory( const std::type_index &type, 
+            const std::string &name_in, const factory_ptr &undecorated )
+    {
+        retire_scope reclaim;
+        std::lock_guard<std::mutex> quiet( background_lock );
+        std::lock_guard<std::mutex> guard( registration_lock );
+        const factory_ptr factory = decorate( type, undecorated );
+        registration_slot *slot = find_own_slot( type, name_in );
+        if( slot && slot->owner )
+        {
+            // Throw an exception as we cannot register a type
+            // which has already been registered
+            throw registration_exception( type.name(), name_in );
+        }
+        if( slot )
+        {
+            // Reuse the slot of a removed registration
+            publish( *slot, factory );
+            return;
+        }
+        layer.types[type].insert( interned_name( name_in ), factory );
+        registration_changed();
+    }
+
+    template<typename unused>
+    IOC_DECL void basic_container<unused>::replace_factory( const std::type_index &type, 
+            const std::string &name_in, const factory_ptr &factory )
+    {
+        retire_scope reclaim;
+        std::lock_guard<std::mutex> quiet( background_lock );
+        std::lock_guard<std::mutex> guard( registration_lock );
+        store_factory( type, name_in, decorate( type, factory ) );
+    }
+
+    template<typename unused>
+    IOC_DECL void basic_container<unused>::store_factory( const std::type_index &type, 
+            const std::string &name_in, const factory_ptr &factory )
+    {
+        registration_slot *slot = find_own_slot( type, name_in );
+        if( slot )
+        {
+            publish( *slot, factory );
+            return;
+        }
+        layer.types[type].insert( interned_name( name_in ), factory );
+        registration_changed();
+    }
+
+    template<typename unused>
+    IOC_DECL std::vector<std::pair<const std::string *, container_core::factory_ptr>> 
+        basic_container<unused>::visible_factories( const std::type_index &type ) const
+    {
+        std::vector<std::pair<const std::string *, factory_ptr>> visible;
+        for( const registry *l = &layer; l; l = l->base.get() )
+        {
+            typename registration_types::const_iterator i = l->types.find( type );
+            if( i == l->types.end() )
+            {
+                continue;
+            }
+            for( typename named_factory::const_iterator j = i->second.begin();
+                    j != i->second.end(); ++j )
+            {
+                if( j->owner && !is_shadowed( type, *j->name.get(), l ) )
+                {
+                    visible.push_back( std::make_pair( j->name.get(), j->owner ) );
+                }
+            }
+        }
+        return visible;
+    }
+
+    template<typename unused>
+    IOC_DECL void basic_container<unused>::rebind_factories( const std::type_index &type,
+            const std::shared_ptr<const dependency_bindings> &bindings )
+    {
+        const std::vector<std::pair<const std::string *, factory_ptr>> 
+            visible = visible_factories( type );
+        for( size_t i = 0; i < visible.size(); ++i )
+        {
+            const factory_ptr bound = visible[i].second->bind_dependencies( bindings );
+            if( bound )
+            {
+                store_factory( type, *visible[i].first, bound );
+            }
+        }
+    }
+
+    template<typename unused>
+    IOC_DECL const ifactory *basic_container<unused>::find_instantiation( 
+            const std::type_index &type, const std::string *name_in ) const
+    {
+        const registration_types *table = 
+            instantiations.load( std::memory_order_acquire );
+        if( !table )
+        {
+            return NULL;
+        }
+        typename registration_types::const_iterator i = table->find( type );
+        if( i == table->end() )
+        {
+            return NULL;
+        }
+        if( name_in )
+        {
+            const registration_slot *slot = i->second.find( *name_in );
+            return slot && !is_shadowed( type, *name_in, NULL ) ? 
+                slot->current.load( std::memory_order_acquire ) : NULL;
+        }
+        for( typename named_factory::const_iterator j = i->second.begin();
+                j != i->second.end(); ++j )
+        {
+            if( !is_shadowed( type, *j->name.get(), NULL ) )
+            {
+                return j->current.load( std::memory_order_acquire );
+            }
+        }
+        return NULL;
+    }
+
+    template<typename unused>
+    IOC_DECL const ifactory *
+        basic_container<unused>::instantiate_family( const std::type_index &type,
+                const std::type_index &family, generic_maker maker, 
+                const std::string *name_in ) const
+    {
+        const registration_types *table = 
+            instantiations.load( std::memory_order_acquire );
+        if( !table || !table->count( type ) )
+        {
+            retire_scope reclaim;
+            std::lock_guard<std::mutex> guard( registration_lock );
+            // Another thread may have instantiated it first
+            table = instantiations.load( std::memory_order_relaxed );
+            if( !table || !table->count( type ) )
+            {
+                std::shared_ptr<registration_types> rebuilt( table ? 
+                        new registration_types( *table ) : new registration_types() );
+                std::vector<registration_slot> added;
+                std::map<std::type_index, generic_names>::const_iterator 
+                    i = generics.find( family );
+                if( i != generics.end() )
+                {
+                    for( generic_names::const_iterator j = i->second.begin(); 
+                            j != i->second.end(); ++j )
+                    {
+                        const std::string &name = *j->first;
+                        factory_ptr made( j->second.second ? 
+                                ifactory::share( new singleton_factory( name, maker() ) ) :
+                                ifactory::share( new resolvable_factory( name, maker() ) ) );
+                        added.push_back( registration_slot( j->second.first,
+                                    decorate( type, made ) ) );
+                    }
+                }
+                std::sort( added.begin(), added.end(), 
+                        []( const registration_slot &a, const registration_slot &b )
+                        {
+                            return *a.name.get() < *b.name.get();
+                        } );
+                (*rebuilt)[type].insert_sorted( added );
+                if( instantiations_owner )
+                {
+                    epoch_domain::instance().retire( instantiations_owner );
+                }
+                instantiations_owner = rebuilt;
+                instantiations.store( rebuilt.get(), std::memory_order_release );
+            }
+        }
+        return find_instantiation( type, name_in );
+    }
+
+    template<typename unused>
+    IOC_DECL void basic_container<unused>::clear_instantiations()
+    {
+        if( !instantiations_owner )
+        {
+            return;
+        }
+        std::vector<std::shared_ptr<void>> retired;
+        for( typename registration_types::const_iterator i = instantiations_owner->begin();
+                i != instantiations_owner->end(); ++i )
+        {
+            for( typename named_factory::const_iterator j = i->second.begin();
+                    j != i->second.end(); ++j )
+            {
+                release_state( j->owner.get(), retired );
+                if( j->owner->undecorated() != j->owner.get() )
+                {
+                    release_state( j->owner->undecorated(), retired );
+                }
+            }
+        }
+        instantiations.store( NULL, std::memory_order_release );
+        epoch_domain::instance().retire( instantiations_owner );
+        instantiations_owner.reset();
+        for( size_t i = 0; i < retired.size(); ++i )
+        {
+            epoch_domain::instance().retire( retired[i] );
+        }
+    }
+
+    template<typename unused>
+    IOC_DECL void basic_container<unused>::add_generic( const std::type_index &family,
+            const std::string &name_in, bool shared )
+    {
+        retire_scope reclaim;
+        std::lock_guard<std::mutex> quiet( background_lock );
+        std::lock_guard<std::mutex> guard( registration_lock );
+        const interned_name name( name_in );
+        if( !generics[family].insert( generic_names::value_type( 
+                        name.get(), std::make_pair( name, shared ) ) ).second )
+        {
+            throw registration_exception( family.name(), name_in );
+        }
+        has_generics.store( true, std::memory_order_release );
+        // Instantiations made before now lack the new name
+        clear_instantiations();
+        registration_changed();
+    }
+
+    template<typename unused>
+    IOC_DECL bool basic_container<unused>::is_shadowed( const std::type_index &type, 
+            const std::string &name_in, const registry *until ) const
+    {
+        for( const registry *l = &layer; l != until; l = l->base.get() )
+        {
+            typename registration_types::const_iterator i = l->types.find(type);
+            if( i != l->types.end() && i->second.find(name_in) )
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    template<typename unused>
+    IOC_DECL const ifactory *
+        basic_container<unused>::resolve_factory( const std::type_index &type,
+                const std::string **name_out ) const
+    {
+        const ifactory *result = NULL;
+        const std::string *result_name = NULL;
+        for( const registry *l = &layer; l; l = l->base.get() )
+        {
+            typename registration_types::const_iterator i = l->types.find(type);
+            if( i == l->types.end() )
+            {
+                continue;
+            }
+            for( typename named_factory::const_iterator j = i->second.begin();
+                    j != i->second.end(); ++j )
+            {
+                if( result_name && !( *j->name.get() < *result_name ) )
+                {
+                    // Names are ordered so nothing better remains
+                    // in this layer.
+                    break;
+                }
+                ifactory *current = 
+                    j->current.load( std::memory_order_acquire );
+                if( current && !is_shadowed( type, *j->name.get(), l ) )
+                {
+                    result = current;
+                    result_name = j->name.get();
+                    break;
+                }
+            }
+        }
+        if( name_out )
+        {
+            *name_out = result_name;
+        }
+        return result;
+    }
+
+    template<typename unused>
+    IOC_DECL const ifactory *
+        basic_container<unused>::resolve_factory_by_name( const std::type_index &type, 
+                const std::string &name_in ) const
+    {
+        // The first layer which mentions the name decides the
+        // outcome, a removal in an upper layer hides any
+        // registration in the layers beneath it.
+        for( const registry *l = &layer; l; l = l->base.get() )
+        {
+            typename registration_types::const_iterator i = l->types.find(type);
+            if( i != l->types.end() )
+            {
+                const registration_slot *c = i->second.find(name_in);
+                if( c )
+                {
+                    return c->current.load( std::memory_order_acquire );
+                }
+            }
+        }
+        return NULL;
+    }
+
+    template<typename unused>
+    IOC_DECL bool
+        basic_container<unused>::remove_factory_by_name( const std::type_index &type,
+                const std::string &name_in )
+    {
+        retire_scope reclaim;
+        std::lock_guard<std::mutex> quiet( background_lock );
+        std::lock_guard<std::mutex> guard( registration_lock );
+        if( !resolve_factory_by_name( type, name_in ) )
+        {
+            return false;
+        }
+        registration_slot *slot = find_own_slot( type, name_in );
+        if( slot )
+        {
+            publish( *slot, factory_ptr() );
+        }
+        else
+        {
+            layer.types[type].insert( interned_name( name_in ), factory_ptr() );
+            registration_changed();
+        }
+        return true;
+    }
+
+    // Factories and names already counted by a report
+    template<typename unused>
+    struct basic_container<unused>::seen_set : std::set<const void *>
+    {
+    };
+
+    template<typename unused>
+    IOC_DECL void
+        basic_container<unused>::layer_usage( const registry &l, memory_report &report,
+                seen_set &seen )
+    {
+        for( typename registration_types::const_iterator i = l.types.begin();
+                i != l.types.end(); ++i )
+        {
+            report.index += map_node_overhead + 
+                sizeof(typename registration_types::value_type);
+            report.entries += i->second.footprint();
+            for( typename named_factory::const_iterator j = i->second.begin();
+                    j != i->second.end(); ++j )
+            {
+                if( j->owner && seen.insert( j->owner.get() ).second )
+                {
+                    report.factories += j->owner->footprint();
+                }
+                if( seen.insert( j->name.get() ).second )
+                {
+                    report.names += name_table::footprint( j->name.get() );
+                }
+            }
+        }
+    }
+
+    template<typename unused>
+    IOC_DECL basic_container<unused>::basic_container() 
+        : self(this, container_deleter()), id( next_id() ),
+        thread_cache_enabled( false ), graph_allocation_enabled( false ),
+        tracer( NULL ), generation( 1 ), dispatch( NULL ),
+        teardown_concurrency( 1 ),
+        teardown_deadline( std::chrono::steady_clock::duration::zero() ),
+        refresher( new background_worker() ),
+        has_generics( false ), instantiations( NULL )
+    {
+        // Register our special shared_ptr which will not
+        // delete if a container is resolved.
+        this->register_instance<container>(self);
+    }
+
+    template<typename unused>
+    IOC_DECL basic_container<unused>::basic_container( const snapshot &base_in ) 
+        : self(this, container_deleter()), id( next_id() ),
+        thread_cache_enabled( false ), graph_allocation_enabled( false ),
+        tracer( NULL ), generation( 1 ), dispatch( NULL ),
+        teardown_concurrency( 1 ),
+        teardown_deadline( std::chrono::steady_clock::duration::zero() ),
+        refresher( new background_worker() ),
+        has_generics( false ), instantiations( NULL )
+    {
+        layer.base = base_in;
+        this->register_instance<container>(self);
+    }
+
+    template<typename unused>
+    IOC_DECL basic_container<unused>::~basic_container()
+    {
+        // Refreshes resolve from the container so stop them first
+        refresher->stop();
+        {
+            // Release what every thread cached from this container
+            std::lock_guard<std::mutex> guard( thread_cache_lock );
+            for( size_t i = 0; i < thread_caches.size(); ++i )
+            {
+                thread_caches[i]->release( false );
+            }
+            thread_caches.clear();
+        }
+        {
+            std::lock_guard<std::mutex> guard( cache_lock );
+            caches.clear();
+        }
+        {
+            std::lock_guard<std::mutex> guard( replica_lock );
+            replica_sets.clear();
+        }
+        {
+            std::lock_guard<std::mutex> guard( pool_lock );
+            pools.clear();
+        }
+
+        // Singletons go first as they may refer to instances
+        // registered with the container.
+        teardown_singletons();
+
+        instantiations.store( NULL );
+        instantiations_owner.reset();
+
+        // Destroy all factories. Factories shared with a snapshot
+        // live on until the last container using them has gone.
+        for( typename registration_types::reverse_iterator i = layer.types.rbegin();
+                i != layer.types.rend(); ++i )
+        {
+            i->second.release();
+        }
+
+        layer.types.clear();
+    }
+
+    template<typename unused>
+    IOC_DECL typename basic_container<unused>::snapshot
+        basic_container<unused>::take_snapshot() const
+    {
+        std::lock_guard<std::mutex> guard( registration_lock );
+        std::shared_ptr<registry> result( new registry() );
+        result->base = layer.base;
+        for( typename registration_types::const_iterator i = layer.types.begin();
+                i != layer.types.end(); ++i )
+        {
+            if( i->first == std::type_index(typeid(container)) )
+            {
+                continue;
+            }
+            // Slots are copied so that replacing a registration
+            // in this container does not change the snapshot.
+            std::vector<registration_slot> candidates;
+            candidates.reserve( i->second.size() );
+            for( typename named_factory::const_iterator j = i->second.begin();
+                    j != i->second.end(); ++j )
+            {
+                candidates.push_back( registration_slot( j->name, j->owner ) );
+            }
+            result->types[i->first].insert_sorted( candidates );
+        }
+        return result;
+    }
+
+    template<typename unused>
+    IOC_DECL void
+        basic_container<unused>::register_batch( const registration_batch &batch )
+    {
+        typedef registration_batch::entry entry;
+        std::vector<const entry *> order;
+        order.reserve( batch.entries.size() );
+        for( size_t i = 0; i < batch.entries.size(); ++i )
+        {
+            order.push_back( &batch.entries[i] );
+        }
+        std::sort( order.begin(), order.end(), registration_batch::entry_less );
+
+        retire_scope reclaim;
+        std::lock_guard<std::mutex> quiet( background_lock );
+        std::lock_guard<std::mutex> guard( registration_lock );
+        for( size_t i = 0; i < order.size(); ++i )
+        {
+            const entry &e = *order[i];
+            const registration_slot *slot = find_own_slot( e.type, *e.name.get() );
+            if( ( i > 0 && order[i - 1]->type == e.type && 
+                        order[i - 1]->name.get() == e.name.get() ) || 
+                    ( slot && slot->owner ) )
+            {
+                throw registration_exception( e.type.name(), *e.name.get() );
+            }
+        }
+
+        // Entries of each type are merged into its storage at once
+        std::vector<registration_slot> added;
+        typename registration_types::iterator hint = layer.types.begin();
+        for( size_t first = 0, last = 0; first < order.size(); first = last )
+        {
+            const std::type_index &type = order[first]->type;
+            hint = layer.types.insert( hint, 
+                    typename registration_types::value_type( type, named_factory() ) );
+            named_factory &names = hint->second;
+            ++hint;
+
+            added.clear();
+            for( last = first; last < order.size() && 
+                    order[last]->type == type; ++last )
+            {
+                registration_slot *slot = names.find( *order[last]->name.get() );
+                const factory_ptr factory = decorate( type, order[last]->factory );
+                if( slot )
+                {
+                    // Reuse the slot of a removed registration
+                    publish( *slot, factory );
+                }
+                else
+                {
+                    added.push_back( registration_slot( 
+                                order[last]->name, factory ) );
+                }
+            }
+            names.insert_sorted( added );
+        }
+        registration_changed();
+    }
+
+    template<typename unused>
+    IOC_DECL memory_report basic_container<unused>::memory_usage() const
+    {
+        memory_report report;
+        seen_set seen;
+        {
+            std::lock_guard<std::mutex> guard( registration_lock );
+            layer_usage( layer, report, seen );
+        }
+        for( const registry *l = layer.base.get(); l; l = l->base.get() )
+        {
+            memory_report base_report;
+            layer_usage( *l, base_report, seen );
+            report.shared += sizeof(registry) + base_report.total();
+        }
+        std::lock_guard<std::mutex> guard( singleton_lock );
+        for( typename singleton_slots::const_iterator i = singletons.begin();
+                i != singletons.end(); ++i )
+        {
+            report.singletons += map_node_overhead + 
+                sizeof(typename singleton_slots::value_type) + sizeof(singleton_slot) +
+                i->second->dependencies.capacity() * sizeof(slot_ptr);
+        }
+        report.interned = name_table::usage();
+        return report;
+    }
+
+    template<typename unused>
+    IOC_DECL resolved_item basic_container<unused>::resolve_key( size_t key ) const
+    {
+        epoch_guard guard;
+        const dispatch_table &table = current_dispatch();
+        if( key < table.keys.size() && table.keys[key] )
+        {
+            return resolve_dispatched( table.keys[key] );
+        }
+        return resolved_item();
+    }
+
+    template<typename unused>
+    IOC_DECL typename basic_container<unused>::thread_cache_slot &
+        basic_container<unused>::local_thread_cache() const
+    {
+        thread_resolve_cache &local = thread_resolve_cache::local();
+        thread_cache_slot *found = local.find( id );
+        if( found )
+        {
+            return *found;
+        }
+        std::shared_ptr<thread_cache_slot> slot( new thread_cache_slot() );
+        {
+            std::lock_guard<std::mutex> guard( thread_cache_lock );
+            // Drop the slots of threads which have exited
+            for( size_t i = 0; i < thread_caches.size(); )
+            {
+                bool abandoned = false;
+                {
+                    std::lock_guard<std::mutex> slot_guard( thread_caches[i]->lock );
+                    abandoned = thread_caches[i]->abandoned;
+                }
+                if( abandoned )
+                {
+                    thread_caches[i].swap( thread_caches.back() );
+                    thread_caches.pop_back();
+                }
+                else
+                {
+                    ++i;
+                }
+            }
+            thread_caches.push_back( slot );
+        }
+        local.add( id, slot );
+        return *slot;
+    }
+
+    template<typename unused>
+    IOC_DECL void basic_container<unused>::clear_thread_cache()
+    {
+        thread_resolve_cache::local().clear();
+    }
+
+    template<typename unused>
+    IOC_DECL std::shared_ptr<void>
+        basic_container<unused>::create_any( const ifactory *factory ) const
+    {
+        if( !graph_allocation_enabled || graph_arena::current() ||
+                factory->shares_items() )
+        {
+            return factory->create_any( *this );
+        }
+        const size_t capacity = factory->measured_graph();
+        graph_arena *arena = graph_arena::create( capacity );
+        std::shared_ptr<void> result;
+        try
+        {
+            graph_scope scope( arena );
+            result = factory->create_any( *this );
+        }
+        catch( ... )
+        {
+            arena->release();
+            throw;
+        }
+        const size_t required = arena->required();
+        arena->release();
+        if( required > capacity )
+        {
+            factory->measure_graph( required );
+        }
+        return result;
+    }
+
+    template<typename unused>
+    IOC_DECL std::shared_ptr<void>
+        basic_container<unused>::resolve_shared( const std::type_info &type,
+                const std::string *name_in, const generic_hook &hook ) const
+    {
+        trace_scope trace( tracer, type );
+        thread_cache_slot *cache = thread_cache_enabled && !name_in ? 
+            &local_thread_cache() : NULL;
+        // Singletons under construction must see every resolve
+        // to record their dependencies.
+        if( cache && constructing().empty() )
+        {
+            const std::shared_ptr<void> *item = 
+                cache->find( generation.load( std::memory_order_acquire ), type );
+            if( item )
+            {
+                trace.hit();
+                return *item;
+            }
+        }
+        epoch_guard guard;
+        const std::type_index index( type );
+        const ifactory *factory = name_in ? 
+            resolve_factory_by_name( index, *name_in ) : resolve_factory( index );
+        if( !factory )
+        {
+            factory = instantiate_generic( index, hook, name_in );
+        }
+        if( !factory )
+        {
+            return std::shared_ptr<void>();
+        }
+        std::shared_ptr<void> result = create_any( factory );
+        if( cache && result && factory->repeats_items() )
+        {
+            cache->store( type, result );
+        }
+        trace.finish( factory, factory->shares_items(), result.get() != NULL );
+        return result;
+    }
+
+    template<typename unused>
+    IOC_DECL container_core::factory_ptr basic_container<unused>::find_owner( 
+            const registration_types &types, const std::type_index &type,
+            const ifactory *factory )
+    {
+        typename registration_types::const_iterator i = types.find( type );
+        if( i != types.end() )
+        {
+            for( typename named_factory::const_iterator j = i->second.begin();
+                    j != i->second.end(); ++j )
+            {
+                if( j->owner.get() == factory )
+                {
+                    return j->owner;
+                }
+            }
+        }
+        return factory_ptr();
+    }
+
+    template<typename unused>
+    IOC_DECL container_core::factory_ptr
+        basic_container<unused>::share_factory( const std::type_info &type,
+                const generic_hook &hook, const std::string *name_in ) const
+    {
+        const std::type_index index( type );
+        for( ;; )
+        {
+            const ifactory *factory = NULL;
+            {
+                epoch_guard guard;
+                factory = name_in ? 
+                    resolve_factory_by_name( index, *name_in ) : resolve_factory( index );
+                if( !factory )
+                {
+                    factory = instantiate_generic( index, hook, name_in );
+                }
+            }
+            if( !factory )
+            {
+                return factory_ptr();
+            }
+            // Owners only change under the registration lock. A factory
+            // replaced since it was found is looked up again.
+            std::lock_guard<std::mutex> guard( registration_lock );
+            for( const registry *l = &layer; l; l = l->base.get() )
+            {
+                factory_ptr owner = find_owner( l->types, index, factory );
+                if( owner )
+                {
+                    return owner;
+                }
+            }
+            if( instantiations_owner )
+            {
+                factory_ptr owner = find_owner( *instantiations_owner, index, factory );
+                if( owner )
+                {
+                    return owner;
+                }
+            }
+        }
+    }
+
+    template<typename unused>
+    IOC_DECL resolved_item
+        basic_container<unused>::resolve_any( const std::type_index &type ) const
+    {
+        epoch_guard guard;
+        // Building the table gives every registered type an id
+        const dispatch_table &table = current_dispatch();
+        size_t type_id = 0;
+        if( type_ids::find( type, type_id ) && type_id < table.types.size() && 
+                table.types[type_id] )
+        {
+            return resolve_dispatched( table.types[type_id] );
+        }
+        return resolved_item();
+    }
+
+    template<typename unused>
+    IOC_DECL resolved_item basic_container<unused>::resolve_id( size_t type_id ) const
+    {
+        epoch_guard guard;
+        const dispatch_table &table = current_dispatch();
+        if( type_id < table.types.size() && table.types[type_id] )
+        {
+            return resolve_dispatched( table.types[type_id] );
+        }
+        return resolved_item();
+    }
+
+    template<typename unused>
+    IOC_DECL std::shared_ptr<void>
+        basic_container<unused>::item_builder::operator()() const
+    {
+        return build( factory.get(), *resolver );
+    }
+
+    template<typename unused>
+    IOC_DECL basic_container<unused>::singleton_factory::singleton_factory( 
+            const std::string &name_in, const construction *recipe_in )
+        : resolvable_factory( name_in, recipe_in )
+    {
+    }
+
+    template<typename unused>
+    IOC_DECL void *
+        basic_container<unused>::singleton_factory::create_item( 
+                const container &resolver ) const
+    {
+        return create_any( resolver ).get();
+    }
+
+    template<typename unused>
+    IOC_DECL std::shared_ptr<ifactory>
+        basic_container<unused>::singleton_factory::clone() const
+    {
+        return ifactory::share( new singleton_factory( *this ) );
+    }
+
+    template<typename unused>
+    IOC_DECL std::shared_ptr<void>
+        basic_container<unused>::singleton_factory::create_any( 
+                const container &resolver ) const
+    {
+        return resolver.resolve_singleton( this, get_plan() );
+    }
+
+    template<typename unused>
+    IOC_DECL basic_container<unused>::cached_factory::cached_factory( 
+            const std::string &name_in, const construction *recipe_in, 
+            std::chrono::steady_clock::duration ttl_in, 
+            size_t capacity_in )
+        : resolvable_factory( name_in, recipe_in ), ttl( ttl_in ), 
+        capacity( capacity_in )
+    {
+    }
+
+    template<typename unused>
+    IOC_DECL std::shared_ptr<void>
+        basic_container<unused>::cached_factory::build( const void *self,
+                const container &resolver )
+    {
+        const cached_factory *factory = static_cast<const cached_factory *>( self );
+        return factory->get_plan().create_shared( *factory, resolver );
+    }
+
+    template<typename unused>
+    IOC_DECL void *
+        basic_container<unused>::cached_factory::create_item( const container & ) const
+    {
+        throw resolution_exception( get_type().name(), 
+                "Cached items are only handed out shared" );
+    }
+
+    template<typename unused>
+    IOC_DECL std::shared_ptr<ifactory>
+        basic_container<unused>::cached_factory::clone() const
+    {
+        return std::shared_ptr<ifactory>( new cached_factory( *this ) );
+    }
+
+    template<typename unused>
+    IOC_DECL std::shared_ptr<void> basic_container<unused>::cached_factory::create_any( 
+            const container &resolver ) const
+    {
+        return create_keyed_any( resolver, std::string() );
+    }
+
+    template<typename unused>
+    IOC_DECL std::shared_ptr<void>
+        basic_container<unused>::cached_factory::create_keyed_any( 
+                const container &resolver, const std::string &key ) const
+    {
+        const item_builder builder = 
+        {
+            this->shared_from_this(), &resolver, &cached_factory::build
+        };
+        return resolver.resolve_cached( this, key, ttl, capacity, builder );
+    }
+
+    template<typename unused>
+    IOC_DECL size_t basic_container<unused>::cached_factory::footprint() const
+    {
+        return sizeof(*this) + get_plan().footprint();
+    }
+
+    template<typename unused>
+    IOC_DECL basic_container<unused>::sharded_factory::sharded_factory( 
+            const std::string &name_in, const construction *recipe_in, 
+            unsigned shards_in )
+        : resolvable_factory( name_in, recipe_in ),
+        shards( shards_in ? shards_in : default_shards() )
+    {
+        if( !shards )
+        {
+            shards = 1;
+        }
+    }
+
+    template<typename unused>
+    IOC_DECL void *
+        basic_container<unused>::sharded_factory::create_item( 
+                const container &resolver ) const
+    {
+        return create_any( resolver ).get();
+    }
+
+    template<typename unused>
+    IOC_DECL std::shared_ptr<ifactory>
+        basic_container<unused>::sharded_factory::clone() const
+    {
+        return ifactory::share( new sharded_factory( *this ) );
+    }
+
+    template<typename unused>
+    IOC_DECL std::shared_ptr<void> basic_container<unused>::sharded_factory::create_any( 
+            const container &resolver ) const
+    {
+        return resolver.resolve_sharded( this, shards, get_plan() );
+    }
+
+    template<typename unused>
+    IOC_DECL size_t basic_container<unused>::sharded_factory::footprint() const
+    {
+        return sizeof(*this) + get_plan().footprint();
+    }
+
+    template<typename unused>
+    IOC_DECL basic_container<unused>::pooled_factory::pooled_factory( 
+            const std::string &name_in, const construction *recipe_in, 
+            size_t low_in, size_t high_in )
+        : resolvable_factory( name_in, recipe_in ),
+        low( low_in ), high( high_in < low_in ? low_in : high_in )
+    {
+    }
+
+    template<typename unused>
+    IOC_DECL std::shared_ptr<void>
+        basic_container<unused>::pooled_factory::build( const void *self,
+                const container &resolver )
+    {
+        const pooled_factory *factory = static_cast<const pooled_factory *>( self );
+        return factory->get_plan().create_shared( *factory, resolver );
+    }
+
+    template<typename unused>
+    IOC_DECL std::shared_ptr<ifactory>
+        basic_container<unused>::pooled_factory::clone() const
+    {
+        return std::shared_ptr<ifactory>( new pooled_factory( *this ) );
+    }
+
+    template<typename unused>
+    IOC_DECL typename basic_container<unused>::item_builder
+        basic_container<unused>::pooled_factory::creator( 
+                const container &resolver ) const
+    {
+        const item_builder builder = 
+        {
+            this->shared_from_this(), &resolver, &pooled_factory::build
+        };
+        return builder;
+    }
+
+    template<typename unused>
+    IOC_DECL std::shared_ptr<void> basic_container<unused>::pooled_factory::create_any( 
+            const container &resolver ) const
+    {
+        return resolver.resolve_pooled( *this, get_plan() );
+    }
+
+    template<typename unused>
+    IOC_DECL size_t basic_container<unused>::pooled_factory::footprint() const
+    {
+        return sizeof(*this) + get_plan().footprint();
+    }
+};
+#endif // IOC_IMPL_H
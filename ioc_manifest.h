@@ -0,0 +1,436 @@
+/*
+ * ioc_manifest.h - Wiring a container from a precompiled manifest
+ * of named implementations
+ *
+ * Copyright (c) 2012 Nicholas A. Smith (nickrmc83@gmail.com)
+ * Distributed under the Boost software license 1.0,
+ * see boost.org for a copy.
+ */
+
+
+#ifndef IOC_MANIFEST_H
+#define IOC_MANIFEST_H
+
+#include "ioc.h"
+
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <istream>
+#include <iterator>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define IOC_MANIFEST_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace ioc
+{
+    // Thrown when a manifest cannot be read, is malformed, or names an
+    // implementation missing from the catalogue it is applied with.
+    class manifest_exception : public std::exception
+    {
+        private:
+            std::string error;
+
+        public:
+            manifest_exception( const std::string &error_in )
+                : std::exception(), error( error_in )
+            {
+            }
+
+            ~manifest_exception() throw()
+            {
+            }
+
+            const char *what() const throw()
+            {
+                return error.c_str();
+            }
+    };
+
+    // Binary manifest layout. A header is followed by fixed size records
+    // and a table holding every string they refer to. Integers are
+    // stored in the byte order of the machine which compiled the
+    // manifest, which is checked when it is opened.
+    namespace manifest_format
+    {
+        static const char magic[4] = { 'I', 'O', 'C', 'M' };
+        static const uint32_t version = 1;
+        static const uint32_t byte_order = 0x01020304;
+
+        struct header
+        {
+            char magic[4];
+            uint32_t version;
+            uint32_t byte_order;
+            uint32_t count;
+            uint64_t strings;
+        };
+
+        // A string is an offset and length within the string table. An
+        // empty registration name stands for an unnamed registration.
+        struct record
+        {
+            uint64_t key;
+            uint32_t interface_offset;
+            uint32_t interface_length;
+            uint32_t implementation_offset;
+            uint32_t implementation_length;
+            uint32_t name_offset;
+            uint32_t name_length;
+        };
+
+        // Catalogue entries are found by a hash of the interface and
+        // implementation keys computed when the manifest is compiled
+        inline uint64_t hash( const char *interface_key, size_t interface_length,
+                const char *implementation_key, size_t implementation_length )
+        {
+            uint64_t result = 14695981039346656037ULL;
+            for( size_t i = 0; i < interface_length; ++i )
+            {
+                result = ( result ^ static_cast<unsigned char>( interface_key[i] ) ) *
+                    1099511628211ULL;
+            }
+            result = result * 1099511628211ULL;
+            for( size_t i = 0; i < implementation_length; ++i )
+            {
+                result = ( result ^ static_cast<unsigned char>( implementation_key[i] ) ) *
+                    1099511628211ULL;
+            }
+            return result;
+        }
+    }
+
+    // Convert a text manifest to its binary form. Each line names an
+    // interface key, an implementation key and optionally the name to
+    // register the implementation with. Blank lines and lines starting
+    // with '#' are ignored.
+    inline void compile_manifest( std::istream &text, std::ostream &binary )
+    {
+        std::vector<manifest_format::record> records;
+        std::string strings;
+        std::string line;
+        for( size_t number = 1; std::getline( text, line ); ++number )
+        {
+            std::istringstream fields( line );
+            std::string keys[4];
+            size_t count = 0;
+            while( count < 4 && fields >> keys[count] )
+            {
+                ++count;
+            }
+            if( count == 0 || keys[0][0] == '#' )
+            {
+                continue;
+            }
+            if( count < 2 || count > 3 )
+            {
+                std::ostringstream error;
+                error << "Malformed manifest line " << number <<
+                    ", expected an interface, an implementation and an optional name";
+                throw manifest_exception( error.str() );
+            }
+
+            manifest_format::record r;
+            r.key = manifest_format::hash( keys[0].data(), keys[0].size(),
+                    keys[1].data(), keys[1].size() );
+            r.interface_offset = static_cast<uint32_t>( strings.size() );
+            r.interface_length = static_cast<uint32_t>( keys[0].size() );
+            strings += keys[0];
+            r.implementation_offset = static_cast<uint32_t>( strings.size() );
+            r.implementation_length = static_cast<uint32_t>( keys[1].size() );
+            strings += keys[1];
+            r.name_offset = static_cast<uint32_t>( strings.size() );
+            r.name_length = static_cast<uint32_t>( keys[2].size() );
+            strings += keys[2];
+            records.push_back( r );
+        }
+
+        manifest_format::header h;
+        std::memcpy( h.magic, manifest_format::magic, sizeof(h.magic) );
+        h.version = manifest_format::version;
+        h.byte_order = manifest_format::byte_order;
+        h.count = static_cast<uint32_t>( records.size() );
+        h.strings = strings.size();
+        binary.write( reinterpret_cast<const char *>( &h ), sizeof(h) );
+        if( !records.empty() )
+        {
+            binary.write( reinterpret_cast<const char *>( &records[0] ),
+                    records.size() * sizeof(manifest_format::record) );
+        }
+        binary.write( strings.data(), strings.size() );
+        if( !binary )
+        {
+            throw manifest_exception( "Failed to write manifest" );
+        }
+    }
+
+    // A compiled manifest. Files are mapped into memory rather than
+    // read where the platform allows. The layout is checked once when
+    // the manifest is opened so that applying it need not.
+    class manifest
+    {
+        private:
+            const char *data;
+            size_t length;
+            size_t count;
+            void *mapping;
+            std::vector<char> buffer;
+
+            manifest( const manifest & );
+            manifest &operator=( const manifest & );
+
+            const char *get_strings() const
+            {
+                return data + sizeof(manifest_format::header) +
+                    size() * sizeof(manifest_format::record);
+            }
+
+            static bool in_table( uint64_t strings, uint32_t offset, uint32_t length )
+            {
+                return static_cast<uint64_t>( offset ) + length <= strings;
+            }
+
+            void validate( const std::string &source )
+            {
+                manifest_format::header h;
+                if( length < sizeof(h) )
+                {
+                    throw manifest_exception( "Invalid manifest " + source );
+                }
+                std::memcpy( &h, data, sizeof(h) );
+                if( std::memcmp( h.magic, manifest_format::magic, sizeof(h.magic) ) != 0 ||
+                        h.version != manifest_format::version ||
+                        h.byte_order != manifest_format::byte_order ||
+                        h.strings > length ||
+                        length - sizeof(h) < static_cast<uint64_t>( h.count ) *
+                        sizeof(manifest_format::record) + h.strings )
+                {
+                    throw manifest_exception( "Invalid manifest " + source );
+                }
+                count = h.count;
+                for( size_t i = 0; i < count; ++i )
+                {
+                    const manifest_format::record r = get_record( i );
+                    if( !in_table( h.strings, r.interface_offset, r.interface_length ) ||
+                            !in_table( h.strings, r.implementation_offset,
+                                r.implementation_length ) ||
+                            !in_table( h.strings, r.name_offset, r.name_length ) )
+                    {
+                        throw manifest_exception( "Invalid manifest " + source );
+                    }
+                }
+            }
+
+            void release()
+            {
+#if defined(IOC_MANIFEST_MMAP)
+                if( mapping )
+                {
+                    munmap( mapping, length );
+                }
+#endif
+            }
+
+        public:
+            // Map a compiled manifest file
+            explicit manifest( const std::string &path )
+                : data( NULL ), length( 0 ), count( 0 ), mapping( NULL )
+            {
+#if defined(IOC_MANIFEST_MMAP)
+                const int file = ::open( path.c_str(), O_RDONLY );
+                struct stat status;
+                if( file < 0 || fstat( file, &status ) != 0 )
+                {
+                    if( file >= 0 )
+                    {
+                        ::close( file );
+                    }
+                    throw manifest_exception( "Cannot open manifest " + path );
+                }
+                length = static_cast<size_t>( status.st_size );
+                if( length )
+                {
+                    mapping = mmap( NULL, length, PROT_READ, MAP_PRIVATE, file, 0 );
+                }
+                ::close( file );
+                if( mapping == MAP_FAILED )
+                {
+                    mapping = NULL;
+                    throw manifest_exception( "Cannot map manifest " + path );
+                }
+                data = static_cast<const char *>( mapping );
+#else
+                std::ifstream file( path.c_str(), std::ios::in | std::ios::binary );
+                if( !file )
+                {
+                    throw manifest_exception( "Cannot open manifest " + path );
+                }
+                buffer.assign( std::istreambuf_iterator<char>( file ),
+                        std::istreambuf_iterator<char>() );
+                data = buffer.empty() ? NULL : &buffer[0];
+                length = buffer.size();
+#endif
+                try
+                {
+                    validate( path );
+                }
+                catch( ... )
+                {
+                    release();
+                    throw;
+                }
+            }
+
+            // Use a compiled manifest already in memory, such as one
+            // embedded in the program. The memory must outlive the
+            // manifest.
+            manifest( const void *data_in, size_t length_in )
+                : data( static_cast<const char *>( data_in ) ), length( length_in ),
+                count( 0 ), mapping( NULL )
+            {
+                validate( "in memory" );
+            }
+
+            ~manifest()
+            {
+                release();
+            }
+
+            size_t size() const
+            {
+                return count;
+            }
+
+            manifest_format::record get_record( size_t index ) const
+            {
+                // Copied out as records need not be aligned in memory
+                manifest_format::record result;
+                std::memcpy( &result, data + sizeof(manifest_format::header) +
+                        index * sizeof(manifest_format::record), sizeof(result) );
+                return result;
+            }
+
+            const char *get_string( uint32_t offset ) const
+            {
+                return get_strings() + offset;
+            }
+    };
+
+    // A catalogue of the implementations a program is built with, each
+    // known by an interface key and an implementation key. Manifests
+    // choose from the catalogue by those keys and name the
+    // registrations they make.
+    class catalogue
+    {
+        private:
+            typedef void (*registrar)( registration_batch &, const std::string & );
+
+            struct entry
+            {
+                std::string interface_key;
+                std::string implementation_key;
+                registrar add;
+            };
+
+            std::unordered_map<uint64_t, entry> entries;
+
+            template<typename I, typename T, typename ...argtypes>
+                static void register_transient( registration_batch &batch, const std::string &name_in )
+                {
+                    batch.register_type_with_name<I, T, argtypes...>( name_in );
+                }
+
+            template<typename I, typename T, typename ...argtypes>
+                static void register_singleton( registration_batch &batch,
+                        const std::string &name_in )
+                {
+                    batch.register_singleton_with_name<I, T, argtypes...>( name_in );
+                }
+
+            void add_entry( const std::string &interface_key,
+                    const std::string &implementation_key, registrar add )
+            {
+                const uint64_t key = manifest_format::hash(
+                        interface_key.data(), interface_key.size(),
+                        implementation_key.data(), implementation_key.size() );
+                entry e = { interface_key, implementation_key, add };
+                if( !entries.insert( std::make_pair( key, e ) ).second )
+                {
+                    throw registration_exception( interface_key, implementation_key );
+                }
+            }
+
+            static bool matches( const std::string &key, const char *data, uint32_t length )
+            {
+                return key.size() == length && std::memcmp( key.data(), data, length ) == 0;
+            }
+
+        public:
+            // Add a transient implementation of interface I
+            template<typename I, typename T, typename ...argtypes>
+                void add( const std::string &interface_key,
+                        const std::string &implementation_key )
+                {
+                    add_entry( interface_key, implementation_key,
+                            &catalogue::register_transient<I, T, argtypes...> );
+                }
+
+            // Add an implementation of interface I resolved as a singleton
+            template<typename I, typename T, typename ...argtypes>
+                void add_singleton( const std::string &interface_key,
+                        const std::string &implementation_key )
+                {
+                    add_entry( interface_key, implementation_key,
+                            &catalogue::register_singleton<I, T, argtypes...> );
+                }
+
+            size_t size() const
+            {
+                return entries.size();
+            }
+
+            // Register every implementation chosen by a manifest with a
+            // container in a single batch. Nothing is registered if any
+            // entry is unknown or already registered.
+            void apply( const manifest &m, container &target ) const
+            {
+                registration_batch batch;
+                batch.reserve( m.size() );
+                for( size_t i = 0; i < m.size(); ++i )
+                {
+                    const manifest_format::record r = m.get_record( i );
+                    std::unordered_map<uint64_t, entry>::const_iterator e =
+                        entries.find( r.key );
+                    if( e == entries.end() ||
+                            !matches( e->second.interface_key,
+                                m.get_string( r.interface_offset ), r.interface_length ) ||
+                            !matches( e->second.implementation_key,
+                                m.get_string( r.implementation_offset ),
+                                r.implementation_length ) )
+                    {
+                        throw manifest_exception( "Unknown implementation " +
+                                std::string( m.get_string( r.implementation_offset ),
+                                    r.implementation_length ) + " of " +
+                                std::string( m.get_string( r.interface_offset ),
+                                    r.interface_length ) );
+                    }
+                    e->second.add( batch, r.name_length ?
+                            std::string( m.get_string( r.name_offset ), r.name_length ) :
+                            unnamed_type_name_registration );
+                }
+                target.register_batch( batch );
+            }
+    };
+};
+#endif // IOC_MANIFEST_H
@@ -0,0 +1,200 @@
+/*
+ * benchmark.cpp - Measures how registration and resolution scale
+ * with the number of registrations held by a container
+ *
+ * Copyright (c) 2012 Nicholas A. Smith (nickrmc83@gmail.com)
+ * Distributed under the Boost software license 1.0,
+ * see boost.org for a copy.
+ */
+
+#include <ioc_container/ioc.h>
+#include <ioc_container/ioc_manifest.h>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+
+// Registrations are spread over a number of interface types as they
+// would be in a real application.
+template<int N>
+class BenchInterface
+{
+    public:
+        virtual ~BenchInterface()
+        {
+        }
+};
+
+template<int N>
+class BenchConcretion : public BenchInterface<N>
+{
+};
+
+typedef void (*SingleRegistrar)( ioc::container &, const std::string & );
+typedef void (*BatchRegistrar)( ioc::registration_batch &, const std::string & );
+typedef bool (*Resolver)( const ioc::container &, const std::string & );
+
+template<int N>
+static void RegisterSingle( ioc::container &Container, const std::string &Name )
+{
+    Container.register_type_with_name<BenchInterface<N>, BenchConcretion<N>>( Name );
+}
+
+template<int N>
+static void RegisterInBatch( ioc::registration_batch &Batch, const std::string &Name )
+{
+    Batch.register_type_with_name<BenchInterface<N>, BenchConcretion<N>>( Name );
+}
+
+template<int N>
+static bool ResolveByName( const ioc::container &Container, const std::string &Name )
+{
+    return Container.resolve_by_name<BenchInterface<N>>( Name ).get() != NULL;
+}
+
+static const SingleRegistrar SingleRegistrars[] =
+{
+    RegisterSingle<0>, RegisterSingle<1>, RegisterSingle<2>, RegisterSingle<3>,
+    RegisterSingle<4>, RegisterSingle<5>, RegisterSingle<6>, RegisterSingle<7>
+};
+
+static const BatchRegistrar BatchRegistrars[] =
+{
+    RegisterInBatch<0>, RegisterInBatch<1>, RegisterInBatch<2>, RegisterInBatch<3>,
+    RegisterInBatch<4>, RegisterInBatch<5>, RegisterInBatch<6>, RegisterInBatch<7>
+};
+
+static const Resolver Resolvers[] =
+{
+    ResolveByName<0>, ResolveByName<1>, ResolveByName<2>, ResolveByName<3>,
+    ResolveByName<4>, ResolveByName<5>, ResolveByName<6>, ResolveByName<7>
+};
+
+static const size_t TypeCount = sizeof(Resolvers) / sizeof(Resolvers[0]);
+
+template<int N>
+static void AddToCatalogue( ioc::catalogue &Catalogue )
+{
+    std::ostringstream Interface;
+    Interface << "interface" << N;
+    Catalogue.add<BenchInterface<N>, BenchConcretion<N>>( Interface.str(), "default" );
+}
+
+static ioc::catalogue MakeCatalogue()
+{
+    ioc::catalogue Result;
+    AddToCatalogue<0>( Result ); AddToCatalogue<1>( Result );
+    AddToCatalogue<2>( Result ); AddToCatalogue<3>( Result );
+    AddToCatalogue<4>( Result ); AddToCatalogue<5>( Result );
+    AddToCatalogue<6>( Result ); AddToCatalogue<7>( Result );
+    return Result;
+}
+
+static const char *const ManifestPath = "benchmark_manifest.bin";
+
+// Compile a manifest making the same registrations as the other paths
+static void WriteManifest( const std::vector<std::string> &Names )
+{
+    std::ostringstream Text;
+    for( size_t i = 0; i < Names.size(); ++i )
+    {
+        // Manifest names cannot contain spaces
+        std::string Name = Names[i];
+        Name[Name.find( ' ' )] = '_';
+        Text << "interface" << i % TypeCount << " default " << Name << "\n";
+    }
+    std::istringstream Input( Text.str() );
+    std::ofstream Output( ManifestPath, std::ios::out | std::ios::binary );
+    ioc::compile_manifest( Input, Output );
+}
+
+typedef std::chrono::steady_clock Clock;
+
+static double ElapsedMilliseconds( Clock::time_point Start )
+{
+    return std::chrono::duration<double, std::milli>( Clock::now() - Start ).count();
+}
+
+// Names are generated in a scattered order so neither registration
+// path benefits from already sorted input.
+static std::vector<std::string> MakeNames( size_t Count )
+{
+    std::vector<std::string> Result;
+    Result.reserve( Count );
+    for( size_t i = 0; i < Count; ++i )
+    {
+        std::ostringstream Name;
+        Name << "Registration " << ( ( i * 7919 ) % Count );
+        Result.push_back( Name.str() );
+    }
+    return Result;
+}
+
+static void RunBenchmark( size_t Count )
+{
+    const std::vector<std::string> Names = MakeNames( Count );
+
+    Clock::time_point Start = Clock::now();
+    ioc::container Single;
+    for( size_t i = 0; i < Count; ++i )
+    {
+        SingleRegistrars[i % TypeCount]( Single, Names[i] );
+    }
+    const double SingleTime = ElapsedMilliseconds( Start );
+
+    Start = Clock::now();
+    ioc::container Bulk;
+    ioc::registration_batch Batch;
+    Batch.reserve( Count );
+    for( size_t i = 0; i < Count; ++i )
+    {
+        BatchRegistrars[i % TypeCount]( Batch, Names[i] );
+    }
+    Bulk.register_batch( Batch );
+    const double BatchTime = ElapsedMilliseconds( Start );
+
+    const ioc::catalogue Catalogue = MakeCatalogue();
+    WriteManifest( Names );
+    Start = Clock::now();
+    ioc::container Wired;
+    Catalogue.apply( ioc::manifest( ManifestPath ), Wired );
+    const double ManifestTime = ElapsedMilliseconds( Start );
+    std::remove( ManifestPath );
+
+    Start = Clock::now();
+    size_t Resolved = 0;
+    for( size_t i = 0; i < Count; ++i )
+    {
+        Resolved += Resolvers[i % TypeCount]( Bulk, Names[i] ) ? 1 : 0;
+    }
+    const double ResolveTime = ElapsedMilliseconds( Start );
+
+    std::cout << std::setw( 8 ) << Count
+        << std::setw( 14 ) << SingleTime
+        << std::setw( 14 ) << BatchTime
+        << std::setw( 14 ) << ManifestTime
+        << std::setw( 14 ) << ResolveTime * 1000000.0 / Count
+        << std::setw( 14 ) << Bulk.memory_usage().total() / Count
+        << ( Resolved == Count ? "" : "  (resolution failed)" ) << std::endl;
+}
+
+int main()
+{
+    std::cout << std::fixed << std::setprecision( 2 );
+    std::cout << std::setw( 8 ) << "count"
+        << std::setw( 14 ) << "single ms"
+        << std::setw( 14 ) << "batch ms"
+        << std::setw( 14 ) << "manifest ms"
+        << std::setw( 14 ) << "resolve ns"
+        << std::setw( 14 ) << "bytes/reg" << std::endl;
+    const size_t Counts[] = { 1000, 10000, 100000 };
+    for( size_t i = 0; i < sizeof(Counts) / sizeof(Counts[0]); ++i )
+    {
+        RunBenchmark( Counts[i] );
+    }
+    return 0;
+}
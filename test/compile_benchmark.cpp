@@ -0,0 +1,77 @@
+/*
+ * compile_benchmark.cpp - A wiring translation unit used to measure
+ * how long translation units using ioc.h take to compile. See
+ * compile_benchmark.sh.
+ *
+ * Copyright (c) 2012 Nicholas A. Smith (nickrmc83@gmail.com)
+ * Distributed under the Boost software license 1.0,
+ * see boost.org for a copy.
+ */
+
+#include <ioc_container/ioc.h>
+
+struct BenchConfig
+{
+};
+
+template<int N>
+struct BenchService
+{
+    virtual ~BenchService()
+    {
+    }
+};
+
+template<int N>
+struct BenchImplementation : public BenchService<N>
+{
+    BenchImplementation( std::shared_ptr<BenchConfig> )
+    {
+    }
+};
+
+// 64 distinct services
+#define BENCH_EIGHT( M, N ) M(N##0) M(N##1) M(N##2) M(N##3) \
+    M(N##4) M(N##5) M(N##6) M(N##7)
+#define BENCH_ALL( M ) BENCH_EIGHT( M, 1 ) BENCH_EIGHT( M, 2 ) \
+    BENCH_EIGHT( M, 3 ) BENCH_EIGHT( M, 4 ) BENCH_EIGHT( M, 5 ) \
+    BENCH_EIGHT( M, 6 ) BENCH_EIGHT( M, 7 ) BENCH_EIGHT( M, 8 )
+
+// The template arguments registering a service after its interface
+#if defined(COMPILE_BENCH_EXPLICIT)
+// Headers which cannot deduce constructor arguments
+#define BENCH_IMPLEMENTATION( N ) BenchImplementation<N>, BenchConfig
+#else
+#define BENCH_IMPLEMENTATION( N ) BenchImplementation<N>
+#endif
+
+#if defined(COMPILE_BENCH_EXTERN)
+#define BENCH_EXTERN( N ) \
+    IOC_EXTERN_REGISTRATION( BenchService<N>, BENCH_IMPLEMENTATION( N ) ); \
+    IOC_EXTERN_RESOLVE( BenchService<N> );
+BENCH_ALL( BENCH_EXTERN )
+#endif
+
+#if defined(COMPILE_BENCH_INSTANTIATE)
+#define BENCH_INSTANTIATE( N ) \
+    IOC_INSTANTIATE_REGISTRATION( BenchService<N>, BENCH_IMPLEMENTATION( N ) ); \
+    IOC_INSTANTIATE_RESOLVE( BenchService<N> );
+BENCH_ALL( BENCH_INSTANTIATE )
+#else
+void Wire( ioc::container &Container )
+{
+    Container.register_instance( std::make_shared<BenchConfig>() );
+#define BENCH_REGISTER( N ) \
+    Container.register_type<BenchService<N>, BENCH_IMPLEMENTATION( N )>();
+    BENCH_ALL( BENCH_REGISTER )
+}
+
+size_t Use( const ioc::container &Container )
+{
+    size_t Resolved = 0;
+#define BENCH_RESOLVE( N ) \
+    Resolved += Container.resolve<BenchService<N>>() ? 1 : 0;
+    BENCH_ALL( BENCH_RESOLVE )
+    return Resolved;
+}
+#endif
@@ -0,0 +1,45 @@
+#!/bin/bash
+# Measures the time taken to compile a wiring translation unit with
+# ioc.h header only, with the non-template core compiled separately
+# and with registrations declared extern as well. With BASELINE set
+# to a git revision the unit is also compiled against the headers of
+# that revision, header only and with the core compiled separately
+# where the revision supports it.
+# Usage: [BASELINE=revision] compile_benchmark.sh [compiler] [flags...]
+# Add -DCOMPILE_BENCH_EXPLICIT to the flags for revisions which cannot
+# deduce constructor arguments.
+
+CXX=${1:-g++}
+shift
+FLAGS=${@:--std=c++0x -O2}
+INCLUDES=${INCLUDES:--I../.. -I../.}
+
+compile()
+{
+    local Start=$(date +%s%N)
+    $CXX $INCLUDES $FLAGS "$@" -c compile_benchmark.cpp -o /dev/null || exit 1
+    local End=$(date +%s%N)
+    echo $(( ( End - Start ) / 1000000 ))
+}
+
+if [ -n "$BASELINE" ]; then
+    BaselineDir=$(mktemp -d)
+    trap 'rm -rf "$BaselineDir"' EXIT
+    mkdir "$BaselineDir/ioc_container"
+    git -C .. archive "$BASELINE" | tar -x -C "$BaselineDir/ioc_container" || exit 1
+    Current=$INCLUDES
+    INCLUDES="-I$BaselineDir"
+    printf "%-40s %8s ms\n" "$BASELINE, header only" $(compile)
+    if grep -q IOC_SEPARATE_COMPILATION "$BaselineDir/ioc_container/ioc.h"; then
+        printf "%-40s %8s ms\n" "$BASELINE, separate core" \
+            $(compile -DIOC_SEPARATE_COMPILATION)
+    fi
+    INCLUDES=$Current
+fi
+
+printf "%-40s %8s ms\n" "header only" $(compile)
+printf "%-40s %8s ms\n" "separate core" $(compile -DIOC_SEPARATE_COMPILATION)
+printf "%-40s %8s ms\n" "separate core, extern registrations" \
+    $(compile -DIOC_SEPARATE_COMPILATION -DCOMPILE_BENCH_EXTERN)
+printf "%-40s %8s ms\n" "instantiations, compiled once" \
+    $(compile -DIOC_SEPARATE_COMPILATION -DCOMPILE_BENCH_INSTANTIATE)
@@ -7,12 +7,107 @@
  */
 
 #include <ioc_container/ioc.h>
+#include <ioc_container/ioc_manifest.h>
 #include <iostream>
 #include <memory>
 #include <vector>
+#include <set>
 #include <stdint.h>
 #include <memory>
 #include <cstring>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <algorithm>
+#include <new>
+#include <cstdlib>
+#include <sstream>
+#include <fstream>
+#include <cstdio>
+#if defined(__cpp_impl_coroutine)
+#include <ioc_container/ioc_async.h>
+#include <chrono>
+#include <thread>
+#endif
+
+// Allocations made by each thread. The global allocation functions
+// are replaced so that tests can assert exact allocation budgets for
+// operations on the hot path.
+static thread_local size_t AllocationCount = 0;
+
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+// The replacements below pair malloc with free by design
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void *operator new( std::size_t Size )
+{
+    ++AllocationCount;
+    void *Result = malloc( Size ? Size : 1 );
+    if( !Result )
+    {
+        throw std::bad_alloc();
+    }
+    return Result;
+}
+
+void *operator new[]( std::size_t Size )
+{
+    return operator new( Size );
+}
+
+void *operator new( std::size_t Size, const std::nothrow_t & ) noexcept
+{
+    ++AllocationCount;
+    return malloc( Size ? Size : 1 );
+}
+
+void *operator new[]( std::size_t Size, const std::nothrow_t &Tag ) noexcept
+{
+    return operator new( Size, Tag );
+}
+
+void operator delete( void *Ptr ) noexcept
+{
+    free( Ptr );
+}
+
+void operator delete[]( void *Ptr ) noexcept
+{
+    free( Ptr );
+}
+
+void operator delete( void *Ptr, const std::nothrow_t & ) noexcept
+{
+    free( Ptr );
+}
+
+void operator delete[]( void *Ptr, const std::nothrow_t & ) noexcept
+{
+    free( Ptr );
+}
+
+#if defined(__cpp_sized_deallocation)
+void operator delete( void *Ptr, std::size_t ) noexcept
+{
+    free( Ptr );
+}
+
+void operator delete[]( void *Ptr, std::size_t ) noexcept
+{
+    free( Ptr );
+}
+#endif
+
+// Number of allocations the calling thread makes while performing
+// an operation, including releasing anything it returns.
+template<typename Operation>
+static size_t CountAllocations( Operation Op )
+{
+    const size_t Before = AllocationCount;
+    Op();
+    return AllocationCount - Before;
+}
 
 // Possible status of tests
 enum TestStatus
@@ -92,8 +187,8 @@ static void PrintTestFailure( const TestFunctionObject &Obj )
 
 // Counters to measure the number of
 // constructed and destructed types.
-static size_t ConstructedCount;
-static size_t DestructedCount;
+static std::atomic<size_t> ConstructedCount;
+static std::atomic<size_t> DestructedCount;
 
 static void ResetCounters()
 {
@@ -133,6 +228,15 @@ struct Concretion : public InterfaceType
     }
 };
 
+// Second concretion used to tell registrations apart
+struct AlternateConcretion : public InterfaceType
+{
+    bool Success() const
+    {
+        return true;
+    }
+};
+
 struct ComplexConcretion : public Concretion
 {
     std::shared_ptr<Concretion> InnerInstance;
@@ -173,6 +277,139 @@ struct CompositeType
     }
 };
 
+// Dependency aligned beyond what allocators guarantee by default
+struct alignas(64) AlignedType
+{
+    char Line[64];
+};
+
+struct AlignedUserType
+{
+    std::shared_ptr<Concretion> Concrete;
+    std::shared_ptr<AlignedType> Aligned;
+
+    AlignedUserType( std::shared_ptr<Concretion> ConcreteIn,
+            std::shared_ptr<AlignedType> AlignedIn )
+        : Concrete( ConcreteIn ), Aligned( AlignedIn )
+    {
+    }
+};
+
+// Composite type which declares the arguments its constructor
+// requires rather than relying on deduction.
+struct DeclaredCompositeType : public CompositeType
+{
+    typedef ioc::dependencies<Concretion, InterfaceType, Concretion> inject;
+
+    DeclaredCompositeType()
+        : CompositeType( std::shared_ptr<Concretion>(),
+                std::shared_ptr<InterfaceType>(), std::shared_ptr<Concretion>() )
+    {
+    }
+
+    DeclaredCompositeType(
+            std::shared_ptr<Concretion> ConcreteIn1,
+            std::shared_ptr<InterfaceType> InterfaceIn,
+            std::shared_ptr<Concretion> ConcreteIn2 )
+        : CompositeType( ConcreteIn1, InterfaceIn, ConcreteIn2 )
+    {
+    }
+};
+
+// Plain value type passed by value
+struct SettingsType
+{
+    int Value;
+};
+
+// Type which takes sole ownership of one dependency, borrows a
+// shared one and takes a copy of a value.
+struct OwningType
+{
+    std::unique_ptr<Concretion> Owned;
+    InterfaceType &Borrowed;
+    SettingsType Settings;
+
+    OwningType( std::unique_ptr<Concretion> OwnedIn,
+            InterfaceType &BorrowedIn, SettingsType SettingsIn )
+        : Owned( std::move( OwnedIn ) ), Borrowed( BorrowedIn ),
+        Settings( SettingsIn )
+    {
+    }
+};
+
+// Order in which teardown types were destroyed
+static std::vector<std::string> DestructionOrder;
+
+// Singleton at the bottom of a dependency chain
+struct TeardownLeaf
+{
+    bool Alive;
+
+    TeardownLeaf() : Alive( true )
+    {
+    }
+
+    ~TeardownLeaf()
+    {
+        Alive = false;
+        DestructionOrder.push_back( "Leaf" );
+    }
+};
+
+// Singleton holding only a reference to the leaf, it must be
+// destroyed before the leaf.
+struct TeardownConsumer
+{
+    TeardownLeaf &Leaf;
+    bool LeafAliveOnDestruction;
+
+    TeardownConsumer( TeardownLeaf &LeafIn ) 
+        : Leaf( LeafIn ), LeafAliveOnDestruction( false )
+    {
+    }
+
+    ~TeardownConsumer()
+    {
+        LeafAliveOnDestruction = Leaf.Alive;
+        DestructionOrder.push_back( Leaf.Alive ? "Consumer" : "Consumer after Leaf" );
+    }
+};
+
+// Singleton with an expensive destructor
+struct SlowTeardown
+{
+    ~SlowTeardown()
+    {
+        std::this_thread::sleep_for( std::chrono::milliseconds( 300 ) );
+    }
+};
+
+template<int Index>
+struct SlowTeardownN : public SlowTeardown
+{
+};
+
+// Type recording the thread which destroyed it
+struct DeferredType : public Concretion
+{
+    static std::atomic<bool> DestroyedOffThread;
+    std::thread::id Creator;
+
+    DeferredType() : Creator( std::this_thread::get_id() )
+    {
+    }
+
+    ~DeferredType()
+    {
+        if( std::this_thread::get_id() != Creator )
+        {
+            DestroyedOffThread = true;
+        }
+    }
+};
+std::atomic<bool> DeferredType::DestroyedOffThread( false );
+
 // The unit tests
 
 // Test we can create and IOC::Container
@@ -567,6 +804,2006 @@ static TestStatus TestRegisterDelegateWithName()
     return Result;
 }
 
+// Test a container derived from a snapshot sees the base
+// registrations and may override them without affecting the base.
+static TestStatus TestSnapshotFork()
+{
+    TestStatus Result = TS_Registration_Error;
+    ioc::container Base;
+    try
+    {
+        Base.register_type<InterfaceType, Concretion>();
+        Base.register_type<Concretion, Concretion>();
+        Base.register_type<ComplexConcretion, ComplexConcretion, Concretion>();
+        ioc::container::snapshot Snapshot = Base.take_snapshot();
+
+        ioc::container Tenant( Snapshot );
+        // Overriding an inherited registration is not an error
+        Tenant.register_type<InterfaceType, AlternateConcretion>();
+        Result = TS_Resolution_Error;
+
+        std::shared_ptr<InterfaceType> FromBase = Base.resolve<InterfaceType>();
+        std::shared_ptr<InterfaceType> FromTenant = Tenant.resolve<InterfaceType>();
+        std::shared_ptr<ComplexConcretion> Inherited = Tenant.resolve<ComplexConcretion>();
+        if( dynamic_cast<Concretion *>( FromBase.get() ) &&
+                dynamic_cast<AlternateConcretion *>( FromTenant.get() ) &&
+                Inherited.get() && Inherited->InnerInstance.get() &&
+                Tenant.resolve<ioc::container>().get() == &Tenant )
+        {
+            Result = TS_Success;
+        }
+    }
+    catch( const std::exception &e )
+    {
+        PrintException( __func__, e );
+    }
+    return Result;
+}
+
+// Test removing an inherited registration only hides it from
+// the derived container.
+static TestStatus TestSnapshotRemoveRegistration()
+{
+    TestStatus Result = TS_Registration_Error;
+    const std::string registration_name = "TestName";
+    ioc::container Base;
+    try
+    {
+        Base.register_type_with_name<Concretion, Concretion>( registration_name );
+        ioc::container Tenant( Base.take_snapshot() );
+        if( Tenant.remove_registration_by_name<Concretion>( registration_name ) &&
+                !Tenant.type_is_registered<Concretion>( registration_name ) &&
+                Base.type_is_registered<Concretion>( registration_name ) )
+        {
+            // The name is free to be registered again in the tenant
+            Tenant.register_type_with_name<Concretion, Concretion>( registration_name );
+            if( Tenant.resolve_by_name<Concretion>( registration_name ).get() )
+            {
+                Result = TS_Success;
+            }
+        }
+    }
+    catch( const std::exception &e )
+    {
+        PrintException( __func__, e );
+    }
+    return Result;
+}
+
+#if defined(__cpp_impl_coroutine)
+// Awaitable standing in for real I/O. The awaiting coroutine is
+// resumed on another thread once the delay has elapsed.
+struct FakeIoDelay
+{
+    std::chrono::milliseconds Delay;
+
+    bool await_ready() const
+    {
+        return false;
+    }
+
+    void await_suspend( std::coroutine_handle<> Handle ) const
+    {
+        std::chrono::milliseconds Wait = Delay;
+        std::thread( [Handle, Wait]()
+                {
+                    std::this_thread::sleep_for( Wait );
+                    Handle.resume();
+                } ).detach();
+    }
+
+    void await_resume() const
+    {
+    }
+};
+
+static const std::chrono::milliseconds FakeIoTime( 200 );
+
+static ioc::task<Concretion *> CreateConcretionAsync()
+{
+    co_await FakeIoDelay{ FakeIoTime };
+    co_return new Concretion();
+}
+
+static ioc::task<InterfaceType *> CreateInterfaceAsync()
+{
+    co_await FakeIoDelay{ FakeIoTime };
+    co_return new AlternateConcretion();
+}
+
+static ioc::task<CompositeType *> CreateCompositeAsync( 
+        std::shared_ptr<Concretion> Concrete1,
+        std::shared_ptr<InterfaceType> Interface,
+        std::shared_ptr<Concretion> Concrete2 )
+{
+    co_return new CompositeType( Concrete1, Interface, Concrete2 );
+}
+
+// Test independent asynchronous dependencies are awaited in
+// parallel rather than one after another.
+static TestStatus TestCoResolveConcurrentDependencies()
+{
+    TestStatus Result = TS_Registration_Error;
+    ioc::container Container;
+    try
+    {
+        ioc::register_async_delegate<Concretion, 
+            ioc::task<Concretion *> (*)()>( Container, CreateConcretionAsync );
+        ioc::register_async_delegate<InterfaceType, 
+            ioc::task<InterfaceType *> (*)()>( Container, CreateInterfaceAsync );
+        ioc::register_async_delegate<CompositeType, 
+            ioc::task<CompositeType *> (*)( std::shared_ptr<Concretion>,
+                    std::shared_ptr<InterfaceType>, std::shared_ptr<Concretion> ),
+            Concretion, InterfaceType, Concretion>( Container, CreateCompositeAsync );
+        Result = TS_Resolution_Error;
+
+        ioc::thread_pool Executor( 3 );
+        std::chrono::steady_clock::time_point Start = std::chrono::steady_clock::now();
+        std::shared_ptr<CompositeType> Composite = ioc::sync_wait( 
+                ioc::co_resolve<CompositeType>( Container, Executor ) );
+        std::chrono::steady_clock::duration Elapsed = 
+            std::chrono::steady_clock::now() - Start;
+
+        // Three delays run back to back would take three times as long
+        if( Composite.get() && Composite->Concrete1.get() &&
+                Composite->Interface.get() && Composite->Concrete2.get() &&
+                Elapsed < FakeIoTime * 2 )
+        {
+            Result = TS_Success;
+        }
+    }
+    catch( const std::exception &e )
+    {
+        PrintException( __func__, e );
+    }
+    return Result;
+}
+
+// Test synchronous resolution still works for asynchronous
+// registrations and asynchronous resolution for synchronous ones.
+static TestStatus TestCoResolveMixedRegistrations()
+{
+    TestStatus Result = TS_Registration_Error;
+    ioc::container Container;
+    try
+    {
+        ioc::register_async_delegate<Concretion, 
+            ioc::task<Concretion *> (*)()>( Container, CreateConcretionAsync );
+        Container.register_type<ComplexConcretion, ComplexConcretion, Concretion>();
+        Result = TS_Resolution_Error;
+
+        ioc::inline_executor Executor;
+        std::shared_ptr<Concretion> Sync = Container.resolve<Concretion>();
+        std::shared_ptr<ComplexConcretion> Async = ioc::sync_wait( 
+                ioc::co_resolve<ComplexConcretion>( Container, Executor ) );
+        std::shared_ptr<InterfaceType> Missing = ioc::sync_wait( 
+                ioc::co_resolve<InterfaceType>( Container, Executor ) );
+        if( Sync.get() && Async.get() && Async->InnerInstance.get() && 
+                !Missing.get() )
+        {
+            Result = TS_Success;
+        }
+    }
+    catch( const std::exception &e )
+    {
+        PrintException( __func__, e );
+    }
+    return Result;
+}
+
+static std::atomic<bool> SlowConcretionStarted( false );
+
+static ioc::task<Concretion *> CreateConcretionSlowly()
+{
+    SlowConcretionStarted = true;
+    co_await FakeIoDelay{ FakeIoTime };
+    co_return new Concretion();
+}
+
+static ioc::task<ComplexConcretion *> CreateComplexAsync( 
+        std::shared_ptr<Concretion> Inner )
+{
+    co_return new ComplexConcretion( Inner );
+}
+
+// Test a registration replaced while an asynchronous resolve of it
+// is suspended stays alive until the resolve completes.
+static TestStatus TestCoResolveReplacedWhileSuspended()
+{
+    TestStatus Result = TS_Registration_Error;
+    ioc::container Container;
+    try
+    {
+        ioc::register_async_delegate<Concretion, 
+            ioc::task<Concretion *> (*)()>( Container, CreateConcretionSlowly );
+        ioc::register_async_delegate<ComplexConcretion, 
+            ioc::task<ComplexConcretion *> (*)( std::shared_ptr<Concretion> ),
+            Concretion>( Container, CreateComplexAsync );
+        Result = TS_Resolution_Error;
+
+        ioc::inline_executor Executor;
+        std::shared_ptr<ComplexConcretion> Complex;
+        std::thread Resolver( [&]()
+                {
+                    Complex = ioc::sync_wait( 
+                            ioc::co_resolve<ComplexConcretion>( Container, Executor ) );
+                } );
+        while( !SlowConcretionStarted )
+        {
+            std::this_thread::yield();
+        }
+        // Without a resolver inside it the old factory would go here
+        Container.replace_registration<ComplexConcretion, ComplexConcretion>();
+        ioc::container::reclaim_retired();
+        Resolver.join();
+        if( Complex.get() && Complex->InnerInstance.get() &&
+                Container.resolve<ComplexConcretion>().get() )
+        {
+            Result = TS_Success;
+        }
+    }
+    catch( const std::exception &e )
+    {
+        PrintException( __func__, e );
+    }
+    return Result;
+}
+#endif
+
+// Test constructor arguments are deduced when they are not given
+// at registration.
+static TestStatus TestRegisterTypeDeducesConstructor()
+{
+    TestStatus Result = TS_Registration_Error;
+    ioc::container Container;
+    try
+    {
+        Container.register_type<Concretion, Concretion>();
+        Container.register_type<InterfaceType, AlternateConcretion>();
+        Container.register_type<ComplexConcretion, ComplexConcretion>();
+        Container.register_type<CompositeType, CompositeType>();
+        Result = TS_Resolution_Error;
+
+        std::shared_ptr<ComplexConcretion> Complex = 
+            Container.resolve<ComplexConcretion>();
+        std::shared_ptr<CompositeType> Composite = 
+            Container.resolve<CompositeType>();
+        if( Complex.get() && Complex->InnerInstance.get() &&
+                Composite.get() && Composite->Concrete1.get() &&
+                Composite->Interface.get() && Composite->Concrete2.get() )
+        {
+            Result = TS_Success;
+        }
+    }
+    catch( const std::exception &e )
+    {
+        PrintException( __func__, e );
+    }
+    return Result;
+}
+
+// Test a declared inject typedef takes precedence over deduction.
+static TestStatus TestRegisterTypeUsesInjectTypedef()
+{
+    TestStatus Result = TS_Registration_Error;
+    ioc::container Container;
+    try
+    {
+        Container.register_type<Concretion, Concretion>();
+        Container.register_type<InterfaceType, AlternateConcretion>();
+        Container.register_type<CompositeType, DeclaredCompositeType>();
+        Result = TS_Resolution_Error;
+
+        std::shared_ptr<CompositeType> Composite = 
+            Container.resolve<CompositeType>();
+        if( Composite.get() && Composite->Concrete1.get() &&
+                Composite->Interface.get() && Composite->Concrete2.get() )
+        {
+            Result = TS_Success;
+        }
+    }
+    catch( const std::exception &e )
+    {
+        PrintException( __func__, e );
+    }
+    return Result;
+}
+
+static SettingsType *CreateSettings()
+{
+    SettingsType *Result = new SettingsType();
+    Result->Value = 42;
+    return Result;
+}
+
+// Test resolving a registered instance shares it rather than
+// taking ownership of it.
+static TestStatus TestResolveInstance()
+{
+    TestStatus Result = TS_Registration_Error;
+    ioc::container Container;
+    try
+    {
+        std::shared_ptr<InterfaceType> Instance( new Concretion() );
+        Container.register_instance<InterfaceType>( Instance );
+        Result = TS_Resolution_Error;
+        if( Container.resolve<InterfaceType>() == Instance &&
+                Container.resolve<InterfaceType>() == Instance &&
+                !Container.resolve_unique<InterfaceType>() &&
+                &Container.resolve_reference<InterfaceType>() == Instance.get() )
+        {
+            Result = TS_Success;
+        }
+    }
+    catch( const std::exception &e )
+    {
+        PrintException( __func__, e );
+    }
+    return Result;
+}
+
+// Test dependencies may be injected as unique_ptr, reference or value.
+static TestStatus TestInjectByOwnershipKind()
+{
+    TestStatus Result = TS_Registration_Error;
+    ioc::container Container;
+    try
+    {
+        std::shared_ptr<InterfaceType> Instance( new AlternateConcretion() );
+        Container.register_instance<InterfaceType>( Instance );
+        Container.register_type<Concretion, Concretion>();
+        Container.register_delegate<SettingsType>( CreateSettings );
+        Container.register_type<OwningType, OwningType, 
+            std::unique_ptr<Concretion>, InterfaceType &, 
+            ioc::by_value<SettingsType>>();
+        Result = TS_Resolution_Error;
+
+        std::unique_ptr<OwningType> Owning = Container.resolve_unique<OwningType>();
+        std::shared_ptr<OwningType> Shared = Container.resolve<OwningType>();
+        if( Owning.get() && Owning->Owned.get() && 
+                &Owning->Borrowed == Instance.get() &&
+                Owning->Settings.Value == 42 && Shared.get() &&
+                Shared->Owned.get() != Owning->Owned.get() )
+        {
+            Result = TS_Success;
+        }
+    }
+    catch( const std::exception &e )
+    {
+        PrintException( __func__, e );
+    }
+    return Result;
+}
+
+// Test a reference to a type which is created per resolve fails
+// rather than dangling.
+static TestStatus TestInjectReferenceToTransientThrows()
+{
+    TestStatus Result = TS_Registration_Error;
+    ioc::container Container;
+    try
+    {
+        Container.register_type<InterfaceType, Concretion>();
+        Container.register_type<Concretion, Concretion>();
+        Container.register_delegate<SettingsType>( CreateSettings );
+        Container.register_type<OwningType, OwningType, 
+            std::unique_ptr<Concretion>, InterfaceType &, 
+            ioc::by_value<SettingsType>>();
+        Result = TS_Resolution_Error;
+        try
+        {
+            Container.resolve<OwningType>();
+        }
+        catch( const ioc::resolution_exception &e )
+        {
+            PrintException( __func__, e );
+            if( DestructedCount == ConstructedCount )
+            {
+                Result = TS_Success;
+            }
+        }
+    }
+    catch( const std::exception &e )
+    {
+        PrintException( __func__, e );
+    }
+    return Result;
+}
+
+// Test cached instances are returned per thread and that any
+// registration change invalidates the cache.
+static TestStatus TestThreadCacheInvalidation()
+{
+    TestStatus Result = TS_Registration_Error;
+    ioc::container Container;
+    try
+    {
+        Container.enable_thread_cache();
+        std::shared_ptr<InterfaceType> First( new Concretion() );
+        std::shared_ptr<InterfaceType> Second( new AlternateConcretion() );
+        Container.register_instance<InterfaceType>( First );
+        Container.register_type<Concretion, Concretion>();
+        Result = TS_Resolution_Error;
+
+        bool Cached = Container.resolve<InterfaceType>().get() == First.get() &&
+            Container.resolve<InterfaceType>().get() == First.get();
+        // Transients are never cached
+        bool Transient = Container.resolve<Concretion>() != 
+            Container.resolve<Concretion>();
+
+        // Another thread sees the same instance through its own cache
+        bool OtherThread = false;
+        std::thread Worker( [&]()
+                {
+                    OtherThread = 
+                        Container.resolve<InterfaceType>().get() == First.get();
+                } );
+        Worker.join();
+
+        Container.remove_registration<InterfaceType>();
+        bool Removed = !Container.resolve<InterfaceType>();
+        Container.register_instance<InterfaceType>( Second );
+        bool Replaced = Container.resolve<InterfaceType>().get() == Second.get();
+
+        ioc::container::clear_thread_cache();
+        if( Cached && Transient && OtherThread && Removed && Replaced && 
+                First.use_count() == 1 )
+        {
+            Result = TS_Success;
+        }
+    }
+    catch( const std::exception &e )
+    {
+        PrintException( __func__, e );
+    }
+    return Result;
+}
+
+// Test destroying a container releases the items other threads
+// cached from it, even when those threads never resolve again.
+static TestStatus TestThreadCacheReleasedWithContainer()
+{
+    TestStatus Result = TS_Registration_Error;
+    std::shared_ptr<InterfaceType> Instance( new Concretion() );
+    try
+    {
+        std::atomic<int> Stage( 0 );
+        std::unique_ptr<ioc::container> Container( new ioc::container() );
+        Container->enable_thread_cache();
+        Container->register_instance<InterfaceType>( Instance );
+        Result = TS_Resolution_Error;
+
+        bool Cached = false;
+        std::thread Worker( [&]()
+                {
+                    Cached = Container->resolve<InterfaceType>().get() == Instance.get();
+                    Stage = 1;
+                    while( Stage != 2 )
+                    {
+                        std::this_thread::yield();
+                    }
+                } );
+        while( Stage != 1 )
+        {
+            std::this_thread::yield();
+        }
+        const bool Held = Instance.use_count() > 2;
+        Container.reset();
+        const bool Released = Instance.use_count() == 1;
+        Stage = 2;
+        Worker.join();
+
+        // The worker's exit released its slot for a live container
+        ioc::container Other;
+        Other.enable_thread_cache();
+        Other.register_instance<InterfaceType>( Instance );
+        std::thread Exiting( [&]()
+                {
+                    Other.resolve<InterfaceType>();
+                } );
+        Exiting.join();
+        if( Cached && Held && Released && Instance.use_count() == 2 )
+        {
+            Result = TS_Success;
+        }
+    }
+    catch( const std::exception &e )
+    {
+        PrintException( __func__, e );
+    }
+    return Result;
+}
+
+// Test a singleton is created once and shared by every resolve.
+static TestStatus TestRegisterSingleton()
+{
+    TestStatus Result = TS_Registration_Error;
+    ioc::container Container;
+    try
+    {
+        Container.register_type<Concretion, Concretion>();
+        Container.register_singleton<ComplexConcretion, ComplexConcretion>();
+        Result = TS_Resolution_Error;
+
+        std::shared_ptr<ComplexConcretion> First = Container.resolve<ComplexConcretion>();
+        std::shared_ptr<ComplexConcretion> Second = Container.resolve<ComplexConcretion>();
+        if( First.get() && First == Second && 
+                &Container.resolve_reference<ComplexConcretion>() == First.get() &&
+                !Container.resolve_unique<ComplexConcretion>() &&
+                ConstructedCount == 2 )
+        {
+            Result = TS_Success;
+        }
+    }
+    catch( const std::exception &e )
+    {
+        PrintException( __func__, e );
+    }
+    return Result;
+}
+
+// Test singletons are released in reverse dependency order
+// regardless of registration order.
+static TestStatus TestTeardownDependencyOrder()
+{
+    TestStatus Result = TS_Unknown;
+    DestructionOrder.clear();
+    try
+    {
+        {
+            ioc::container Container;
+            Container.register_singleton<TeardownConsumer, TeardownConsumer, 
+                TeardownLeaf &>();
+            Container.register_singleton<TeardownLeaf, TeardownLeaf>();
+            Container.set_teardown_concurrency( 4 );
+            Container.resolve<TeardownConsumer>();
+        }
+        if( DestructionOrder.size() == 2 && 
+                DestructionOrder[0] == "Consumer" &&
+                DestructionOrder[1] == "Leaf" )
+        {
+            Result = TS_Success;
+        }
+    }
+    catch( const std::exception &e )
+    {
+        PrintException( __func__, e );
+    }
+    return Result;
+}
+
+// Test independent singletons are released in parallel and that
+// a deadline bounds how long destruction takes.
+static TestStatus TestTeardownParallelWithDeadline()
+{
+    TestStatus Result = TS_Unknown;
+    ioc::container *Container = NULL;
+    try
+    {
+        Container = new ioc::container();
+        Container->register_singleton<SlowTeardownN<0>, SlowTeardownN<0>>();
+        Container->register_singleton<SlowTeardownN<1>, SlowTeardownN<1>>();
+        Container->register_singleton<SlowTeardownN<2>, SlowTeardownN<2>>();
+        Container->resolve<SlowTeardownN<0>>();
+        Container->resolve<SlowTeardownN<1>>();
+        Container->resolve<SlowTeardownN<2>>();
+        Container->set_teardown_concurrency( 3 );
+        std::chrono::steady_clock::time_point Start = std::chrono::steady_clock::now();
+        delete Container;
+        std::chrono::steady_clock::duration Parallel = 
+            std::chrono::steady_clock::now() - Start;
+
+        Container = new ioc::container();
+        Container->register_singleton<SlowTeardownN<0>, SlowTeardownN<0>>();
+        Container->resolve<SlowTeardownN<0>>();
+        Container->set_teardown_deadline( std::chrono::milliseconds( 50 ) );
+        Start = std::chrono::steady_clock::now();
+        delete Container;
+        Container = NULL;
+        std::chrono::steady_clock::duration Bounded = 
+            std::chrono::steady_clock::now() - Start;
+
+        // Serial teardown would take 900ms and 300ms respectively
+        if( Parallel < std::chrono::milliseconds( 600 ) &&
+                Bounded < std::chrono::milliseconds( 250 ) )
+        {
+            Result = TS_Success;
+        }
+        // Let the abandoned destructor finish before the next test
+        std::this_thread::sleep_for( std::chrono::milliseconds( 300 ) );
+    }
+    catch( const std::exception &e )
+    {
+        PrintException( __func__, e );
+    }
+    return Result;
+}
+
+// Test replacing a registration while other threads resolve it
+// never leaves a window where the type is missing.
+static TestStatus TestReplaceRegistrationUnderLoad()
+{
+    TestStatus Result = TS_Registration_Error;
+    ioc::container Container;
+    try
+    {
+        Container.register_type<InterfaceType, Concretion>();
+        Result = TS_Resolution_Error;
+
+        std::atomic<bool> Stop( false );
+        std::atomic<size_t> Missing( 0 );
+        std::atomic<size_t> Resolved( 0 );
+        std::vector<std::thread> Resolvers;
+        for( int i = 0; i < 3; ++i )
+        {
+            Resolvers.push_back( std::thread( [&]()
+                        {
+                            while( !Stop )
+                            {
+                                std::shared_ptr<InterfaceType> Value =
+                                    Container.resolve<InterfaceType>();
+                                if( !Value.get() || !Value->Success() )
+                                {
+                                    ++Missing;
+                                }
+                                ++Resolved;
+                            }
+                        } ) );
+        }
+        for( int i = 0; i < 2000; ++i )
+        {
+            if( i % 2 )
+            {
+                Container.replace_registration<InterfaceType, Concretion>();
+            }
+            else
+            {
+                Container.replace_registration<InterfaceType, AlternateConcretion>();
+            }
+        }
+        // Give the resolvers time to run against the final registration
+        while( Resolved < 1000 )
+        {
+            std::this_thread::yield();
+        }
+        Stop = true;
+        for( size_t i = 0; i < Resolvers.size(); ++i )
+        {
+            Resolvers[i].join();
+        }
+        ioc::container::reclaim_retired();
+
+        if( Missing == 0 && 
+                dynamic_cast<Concretion *>( Container.resolve<InterfaceType>().get() ) )
+        {
+            Result = TS_Success;
+        }
+    }
+    catch( const std::exception &e )
+    {
+        PrintException( __func__, e );
+    }
+    return Result;
+}
+
+// Singleton whose destructor changes the container it came from
+struct RegistryChangingType
+{
+    static ioc::container *Owner;
+
+    ~RegistryChangingType()
+    {
+        Owner->remove_registration<Concretion>();
+    }
+};
+
+ioc::container *RegistryChangingType::Owner = NULL;
+
+// Test a replaced singleton is destroyed once the container's locks
+// are released, so its destructor may change the registrations.
+static TestStatus TestReplacedSingletonChangesRegistry()
+{
+    TestStatus Result = TS_Registration_Error;
+    ioc::container Container;
+    try
+    {
+        RegistryChangingType::Owner = &Container;
+        Container.register_type<Concretion, Concretion>();
+        Container.register_singleton<RegistryChangingType, RegistryChangingType>();
+        Result = TS_Resolution_Error;
+
+        const bool Resolved = Container.resolve<RegistryChangingType>().get() != NULL;
+        Container.replace_registration<RegistryChangingType, RegistryChangingType>();
+        ioc::container::reclaim_retired();
+        const bool Removed = !Container.resolve<Concretion>() &&
+                Container.resolve<RegistryChangingType>().get();
+        // Released before the container goes
+        Container.remove_registration<RegistryChangingType>();
+        if( Resolved && Removed )
+        {
+            Result = TS_Success;
+        }
+    }
+    catch( const std::exception &e )
+    {
+        PrintException( __func__, e );
+    }
+    return Result;
+}
+
+// Memory accounting grows with registrations, shares snapshot
+// layers and resolves named registrations added in any order.
+static TestStatus TestMemoryUsage()
+{
+    TestStatus Result = TS_Registration_Error;
+    ioc::container Container;
+    try
+    {
+        const ioc::memory_report Empty = Container.memory_usage();
+        Container.register_type_with_name<InterfaceType, Concretion>( "Zulu" );
+        Container.register_type_with_name<InterfaceType, AlternateConcretion>( "Alpha" );
+        Container.register_type_with_name<InterfaceType, Concretion>( "Mike" );
+        Container.register_type_with_name<Concretion, Concretion>( "Alpha" );
+        Result = TS_Resolution_Error;
+
+        const ioc::memory_report Full = Container.memory_usage();
+        ioc::container Derived( Container.take_snapshot() );
+        const ioc::memory_report Shared = Derived.memory_usage();
+        // Interned names are freed with the last registration using them
+        size_t Held = 0;
+        {
+            ioc::container Tenant;
+            Tenant.register_type_with_name<Concretion, Concretion>( "MemoryUsage Kilo" );
+            Held = Tenant.memory_usage().interned;
+        }
+        const bool Interned = Full.interned >= Full.names && 
+            Held > Full.interned && Container.memory_usage().interned < Held;
+
+        if( Full.total() > Empty.total() && Full.factories > Empty.factories &&
+                Full.entries > Empty.entries && Full.names > Empty.names &&
+                Empty.shared == 0 && Shared.shared > 0 &&
+                Shared.entries < Full.entries &&
+                dynamic_cast<AlternateConcretion *>( 
+                    Container.resolve<InterfaceType>().get() ) &&
+                dynamic_cast<Concretion *>( 
+                    Derived.resolve_by_name<InterfaceType>( "Mike" ).get() ) &&
+                Derived.resolve_by_name<Concretion>( "Alpha" ) && Interned )
+        {
+            Result = TS_Success;
+        }
+    }
+    catch( const std::exception &e )
+    {
+        PrintException( __func__, e );
+    }
+    return Result;
+}
+
+// A batch registers everything at once and a batch containing a
+// duplicate is rejected without registering any of it.
+static TestStatus TestRegisterBatch()
+{
+    TestStatus Result = TS_Registration_Error;
+    ioc::container Container;
+    try
+    {
+        Container.register_type_with_name<InterfaceType, Concretion>( "Mike" );
+        Container.remove_registration_by_name<InterfaceType>( "Mike" );
+
+        ioc::registration_batch Batch;
+        Batch.reserve( 4 );
+        Batch.register_type_with_name<InterfaceType, Concretion>( "Zulu" );
+        Batch.register_type_with_name<InterfaceType, AlternateConcretion>( "Alpha" );
+        Batch.register_type_with_name<InterfaceType, Concretion>( "Mike" );
+        Batch.register_type<Concretion, Concretion>();
+        Container.register_batch( Batch );
+
+        ioc::registration_batch Duplicate;
+        Duplicate.register_type_with_name<Concretion, Concretion>( "Fresh" );
+        Duplicate.register_type_with_name<InterfaceType, Concretion>( "Zulu" );
+        bool Rejected = false;
+        try
+        {
+            Container.register_batch( Duplicate );
+        }
+        catch( const ioc::registration_exception & )
+        {
+            Rejected = true;
+        }
+        Result = TS_Resolution_Error;
+
+        if( Rejected && !Container.type_is_registered<Concretion>( "Fresh" ) &&
+                dynamic_cast<AlternateConcretion *>( 
+                    Container.resolve<InterfaceType>().get() ) &&
+                Container.resolve_by_name<InterfaceType>( "Mike" ) &&
+                Container.resolve_by_name<InterfaceType>( "Zulu" ) &&
+                Container.resolve<Concretion>() )
+        {
+            Result = TS_Success;
+        }
+    }
+    catch( const std::exception &e )
+    {
+        PrintException( __func__, e );
+    }
+    return Result;
+}
+
+// With graph allocation enabled a transient graph is placed in one
+// block once its size is known and is fully released with its root.
+static TestStatus TestGraphAllocation()
+{
+    TestStatus Result = TS_Registration_Error;
+    ioc::container Container;
+    try
+    {
+        Container.register_type<Concretion, Concretion>();
+        Container.register_type<InterfaceType, Concretion>();
+        Container.register_type<CompositeType, CompositeType, 
+            Concretion, InterfaceType, Concretion>();
+        Container.enable_graph_allocation();
+        Result = TS_Resolution_Error;
+
+        // The first resolve measures the graph
+        Container.resolve<CompositeType>();
+        std::shared_ptr<CompositeType> Composite = Container.resolve<CompositeType>();
+        if( Composite.get() && Composite->Concrete1.get() &&
+                Composite->Interface.get() && Composite->Concrete2.get() )
+        {
+            const char *Items[] = 
+            {
+                reinterpret_cast<const char *>( Composite.get() ),
+                reinterpret_cast<const char *>( Composite->Concrete1.get() ),
+                reinterpret_cast<const char *>( Composite->Interface.get() ),
+                reinterpret_cast<const char *>( Composite->Concrete2.get() )
+            };
+            const char *Lowest = *std::min_element( Items, Items + 4 );
+            const char *Highest = *std::max_element( Items, Items + 4 );
+            // Four items and their control blocks laid out together
+            const bool Contiguous = static_cast<size_t>( Highest - Lowest ) < 
+                sizeof(CompositeType) + 3 * sizeof(Concretion) + 8 * sizeof(void *) * 4;
+
+            Composite.reset();
+            const bool Released = ConstructedCount == 6 && DestructedCount == 6;
+            bool Aligned = true;
+#if defined(__cpp_aligned_new)
+            // Over-aligned items keep their alignment
+            ioc::container AlignedContainer;
+            AlignedContainer.register_type<Concretion, Concretion>();
+            AlignedContainer.register_type<AlignedType, AlignedType>();
+            AlignedContainer.register_type<AlignedUserType, AlignedUserType,
+                Concretion, AlignedType>();
+            AlignedContainer.enable_graph_allocation();
+            for( int i = 0; i < 4; ++i )
+            {
+                const std::shared_ptr<AlignedUserType> User = 
+                    AlignedContainer.resolve<AlignedUserType>();
+                Aligned = Aligned && User && User->Aligned &&
+                    reinterpret_cast<uintptr_t>( User->Aligned.get() ) % 
+                    alignof(AlignedType) == 0;
+            }
+#endif
+            if( Contiguous && Released && Aligned )
+            {
+                Result = TS_Success;
+            }
+        }
+    }
+    catch( const std::exception &e )
+    {
+        PrintException( __func__, e );
+    }
+    return Result;
+}
+
+// Deferred registrations are destroyed by the reclamation queue,
+// either on flush or by its worker.
+static TestStatus TestDeferredDestruction()
+{
+    TestStatus Result = TS_Registration_Error;
+    ioc::container Container;
+    try
+    {
+        // Neither the batch size nor the interval are reached
+        std::shared_ptr<ioc::reclamation_queue> Held( 
+                new ioc::reclamation_queue( 1000, std::chrono::hours( 1 ) ) );
+        std::shared_ptr<ioc::reclamation_queue> Background( 
+                new ioc::reclamation_queue( 1 ) );
+        Container.register_deferred_with_name<Concretion, DeferredType>( 
+                "Held", Held );
+        Container.register_deferred_with_name<Concretion, DeferredType>( 
+                "Background", Background );
+        Result = TS_Resolution_Error;
+
+        DeferredType::DestroyedOffThread = false;
+        Container.resolve_by_name<Concretion>( "Held" );
+        const bool Queued = DestructedCount == 0 && Held->pending() == 1;
+        Held->flush();
+        const bool Flushed = DestructedCount == 1 && Held->pending() == 0 &&
+            !DeferredType::DestroyedOffThread;
+
+        Container.resolve_by_name<Concretion>( "Background" );
+        for( int i = 0; i < 1000 && DestructedCount < 2; ++i )
+        {
+            std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+        }
+        Background->drain();
+
+        if( Queued && Flushed && DestructedCount == 2 && 
+                DeferredType::DestroyedOffThread )
+        {
+            Result = TS_Success;
+        }
+    }
+    catch( const std::exception &e )
+    {
+        PrintException( __func__, e );
+    }
+    return Result;
+}
+
+// Request specific values passed to resolve rather than registered
+struct RequestId
+{
+    int Value;
+};
+
+struct RequestHandler
+{
+    std::shared_ptr<Concretion> Service;
+    RequestId Id;
+    std::string &User;
+
+    typedef ioc::dependencies<Concretion, ioc::argument<RequestId>, 
+            ioc::argument<std::string &>> inject;
+
+    RequestHandler( std::shared_ptr<Concretion> ServiceIn, RequestId IdIn,
+            std::string &UserIn )
+        : Service( ServiceIn ), Id( IdIn ), User( UserIn )
+    {
+    }
+};
+
+// Every resolve kind makes an exact number of allocations. A change
+// adding an allocation to any of these paths fails the test.
+static TestStatus TestResolveAllocationBudgets()
+{
+    TestStatus Result = TS_Registration_Error;
+    ioc::container Container;
+    ioc::container Cached;
+    ioc::container Graph;
+    ioc::container Lifetimes;
+    ioc::container Pooled;
+    try
+    {
+        std::shared_ptr<InterfaceType> Instance( new Concretion() );
+        Container.register_instance<InterfaceType>( Instance );
+        Container.register_type<Concretion, Concretion>();
+        Container.register_type_with_name<Concretion, Concretion>( "Named" );
+        Container.register_singleton<SettingsType, SettingsType>();
+        Container.register_type<CompositeType, CompositeType, 
+            Concretion, InterfaceType, Concretion>();
+        Container.bind_key<Concretion>( 0 );
+        Container.register_type<RequestHandler, RequestHandler>();
+        Cached.register_instance<InterfaceType>( Instance );
+        Cached.enable_thread_cache();
+        Graph.register_type<Concretion, Concretion>();
+        Graph.register_type<InterfaceType, Concretion>();
+        Graph.register_type<CompositeType, CompositeType, 
+            Concretion, InterfaceType, Concretion>();
+        Graph.enable_graph_allocation();
+        Lifetimes.register_cached<Concretion, Concretion>( 
+                std::chrono::steady_clock::duration::zero() );
+        Lifetimes.register_sharded<InterfaceType, Concretion>();
+        Pooled.register_pooled<InterfaceType, Concretion>( 1, 4 );
+        Result = TS_Resolution_Error;
+
+        // Warm up per thread state, singletons and graph sizes
+        Container.resolve<SettingsType>();
+        Cached.resolve<InterfaceType>();
+        Graph.resolve<CompositeType>();
+        Container.resolve_key( 0 );
+        Lifetimes.resolve<Concretion>();
+        Lifetimes.resolve_keyed<Concretion>( "Key" );
+        Lifetimes.resolve<InterfaceType>();
+        // The first resolve starts filling the pool. A pop leaving at
+        // least the low watermark queues no refill.
+        Pooled.resolve<InterfaceType>();
+        for( int i = 0; i < 1000 && 
+                Pooled.get_pool_statistics<InterfaceType>().ready < 4; ++i )
+        {
+            std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+        }
+        std::string User = "alice";
+        const RequestId Id = { 7 };
+
+        struct Budget
+        {
+            const char *Name;
+            size_t Expected;
+            size_t Actual;
+        };
+        const Budget Budgets[] =
+        {
+            // Registered instances and the container itself
+            { "instance", 0, CountAllocations( [&]() 
+                    { Container.resolve<InterfaceType>(); } ) },
+            { "instance reference", 0, CountAllocations( [&]() 
+                    { Container.resolve_reference<InterfaceType>(); } ) },
+            { "container", 0, CountAllocations( [&]() 
+                    { Container.resolve<ioc::container>(); } ) },
+            { "thread cached", 0, CountAllocations( [&]() 
+                    { Cached.resolve<InterfaceType>(); } ) },
+            // Shared lifetimes once created
+            { "singleton", 0, CountAllocations( [&]() 
+                    { Container.resolve<SettingsType>(); } ) },
+            { "cached", 0, CountAllocations( [&]() 
+                    { Lifetimes.resolve<Concretion>(); } ) },
+            { "cached by key", 0, CountAllocations( [&]() 
+                    { Lifetimes.resolve_keyed<Concretion>( "Key" ); } ) },
+            { "sharded replica", 0, CountAllocations( [&]() 
+                    { Lifetimes.resolve<InterfaceType>(); } ) },
+            { "ready pool", 0, CountAllocations( [&]() 
+                    { Pooled.resolve<InterfaceType>(); } ) },
+            // Transients, one allocation per constructed item
+            { "transient", 1, CountAllocations( [&]() 
+                    { Container.resolve<Concretion>(); } ) },
+            { "transient by name", 1, CountAllocations( [&]() 
+                    { Container.resolve_by_name<Concretion>( "Named" ); } ) },
+            { "transient by key", 1, CountAllocations( [&]() 
+                    { Container.resolve_key( 0 ); } ) },
+            { "unique transient", 1, CountAllocations( [&]() 
+                    { Container.resolve_unique<Concretion>(); } ) },
+            // Two transient dependencies and a registered instance
+            { "transient graph", 3, CountAllocations( [&]() 
+                    { Container.resolve<CompositeType>(); } ) },
+            { "transient graph in one block", 1, CountAllocations( [&]() 
+                    { Graph.resolve<CompositeType>(); } ) },
+            // The handler and its transient dependency
+            { "runtime arguments", 2, CountAllocations( [&]() 
+                    { Container.resolve<RequestHandler>( Id, User ); } ) }
+        };
+
+        Result = TS_Success;
+        for( size_t i = 0; i < sizeof(Budgets) / sizeof(Budgets[0]); ++i )
+        {
+            std::cout << Budgets[i].Name << ": " << Budgets[i].Actual 
+                << " allocations, budget " << Budgets[i].Expected << std::endl;
+            if( Budgets[i].Actual != Budgets[i].Expected )
+            {
+                Result = TS_Resolution_Error;
+            }
+        }
+    }
+    catch( const std::exception &e )
+    {
+        PrintException( __func__, e );
+    }
+    return Result;
+}
+
+// Traced resolves produce nested spans with their outcome which are
+// exported as Chrome trace JSON.
+static TestStatus TestResolveTracing()
+{
+    TestStatus Result = TS_Registration_Error;
+    ioc::container Container;
+    try
+    {
+        std::shared_ptr<ioc::resolve_tracer> Tracer( new ioc::resolve_tracer() );
+        Container.register_type<Concretion, Concretion>();
+        Container.register_singleton<InterfaceType, Concretion>();
+        Container.register_type<CompositeType, CompositeType, 
+            Concretion, InterfaceType, Concretion>();
+        Container.set_tracer( Tracer );
+        Result = TS_Resolution_Error;
+
+        Container.resolve<CompositeType>();
+        Container.resolve<InterfaceType>();
+        Container.resolve<SettingsType>();
+        Container.set_tracer( std::shared_ptr<ioc::resolve_tracer>() );
+        Container.resolve<Concretion>();
+
+        std::ostringstream Trace;
+        Tracer->write_chrome_trace( Trace );
+        const std::string Json = Trace.str();
+        const size_t CompositeBegin = 
+            Json.find( "\"name\":\"CompositeType\",\"cat\":\"resolve\",\"ph\":\"B\"" );
+        const size_t DependencyBegin = 
+            Json.find( "\"name\":\"Concretion\",\"cat\":\"resolve\",\"ph\":\"B\"" );
+        const size_t CompositeEnd = 
+            Json.find( "\"name\":\"CompositeType\",\"cat\":\"resolve\",\"ph\":\"E\"" );
+
+        // Composite, three dependencies, a second singleton resolve
+        // and an unregistered type, each opened and closed
+        if( Tracer->event_count() == 12 && 
+                CompositeBegin < DependencyBegin && DependencyBegin < CompositeEnd &&
+                CompositeEnd != std::string::npos &&
+                Json.find( "\"outcome\":\"constructed\",\"registration\":"
+                    "\"Unnamed registration\"" ) != std::string::npos &&
+                Json.find( "\"outcome\":\"cache_hit\"" ) != std::string::npos &&
+                Json.find( "\"outcome\":\"failed\"" ) != std::string::npos )
+        {
+            Result = TS_Success;
+        }
+    }
+    catch( const std::exception &e )
+    {
+        PrintException( __func__, e );
+    }
+    return Result;
+}
+
+// Cached items are reused until they expire, then replaced in the
+// background while the stale item is still handed out.
+static TestStatus TestCachedLifetimeRefresh()
+{
+    TestStatus Result = TS_Registration_Error;
+    ioc::container Container;
+    try
+    {
+        Container.register_cached<Concretion, Concretion>( 
+                std::chrono::milliseconds( 50 ) );
+        Result = TS_Resolution_Error;
+
+        std::shared_ptr<Concretion> First = Container.resolve<Concretion>();
+        const bool Reused = Container.resolve<Concretion>() == First &&
+            ConstructedCount == 1;
+
+        std::this_thread::sleep_for( std::chrono::milliseconds( 60 ) );
+        const bool Stale = Container.resolve<Concretion>() == First;
+        std::shared_ptr<Concretion> Refreshed = First;
+        for( int i = 0; i < 1000 && Refreshed == First; ++i )
+        {
+            std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+            Refreshed = Container.resolve<Concretion>();
+        }
+
+        // No unowned pointer to a cached item is handed out
+        bool Unowned = true;
+        try
+        {
+            Container.get_factory<Concretion>()->create_item( Container );
+        }
+        catch( const ioc::resolution_exception & )
+        {
+            Unowned = false;
+        }
+
+        if( Reused && Stale && Refreshed.get() && Refreshed != First &&
+                !Container.resolve_unique<Concretion>() && !Unowned )
+        {
+            Result = TS_Success;
+        }
+    }
+    catch( const std::exception &e )
+    {
+        PrintException( __func__, e );
+    }
+    return Result;
+}
+
+// Cached items are kept per resolve-time key and the least recently
+// used key is evicted beyond the capacity.
+static TestStatus TestCachedLifetimeEviction()
+{
+    TestStatus Result = TS_Registration_Error;
+    ioc::container Container;
+    try
+    {
+        Container.register_cached<InterfaceType, Concretion>( 
+                std::chrono::steady_clock::duration::zero(), 2 );
+        Result = TS_Resolution_Error;
+
+        std::shared_ptr<InterfaceType> A = Container.resolve_keyed<InterfaceType>( "a" );
+        std::shared_ptr<InterfaceType> B = Container.resolve_keyed<InterfaceType>( "b" );
+        const bool Distinct = A != B && 
+            Container.resolve_keyed<InterfaceType>( "a" ) == A;
+        // "b" is now the least recently used
+        Container.resolve_keyed<InterfaceType>( "c" );
+
+        if( Distinct && Container.resolve_keyed<InterfaceType>( "a" ) == A &&
+                Container.resolve_keyed<InterfaceType>( "b" ) != B )
+        {
+            Result = TS_Success;
+        }
+    }
+    catch( const std::exception &e )
+    {
+        PrintException( __func__, e );
+    }
+    return Result;
+}
+
+// A cached item first resolved beneath a graph allocated root is
+// created outside its arena, so it does not pin the root's block.
+static TestStatus TestCachedLifetimeOutsideGraph()
+{
+    TestStatus Result = TS_Registration_Error;
+    ioc::container Cached;
+    ioc::container Singleton;
+    try
+    {
+        Cached.register_cached<Concretion, Concretion>( 
+                std::chrono::steady_clock::duration::zero() );
+        Cached.register_type<ComplexConcretion, ComplexConcretion, Concretion>();
+        Cached.enable_graph_allocation();
+        Singleton.register_singleton<Concretion, Concretion>();
+        Singleton.register_type<ComplexConcretion, ComplexConcretion, Concretion>();
+        Singleton.enable_graph_allocation();
+        Result = TS_Resolution_Error;
+
+        std::shared_ptr<ComplexConcretion> Complex = 
+            Cached.resolve<ComplexConcretion>();
+        Singleton.resolve<ComplexConcretion>();
+        const std::shared_ptr<Concretion> Inner = Complex->InnerInstance;
+        Complex.reset();
+        // Only the root is measured into either graph
+        const size_t Measured = 
+            Cached.get_factory<ComplexConcretion>()->measured_graph();
+        if( Inner.get() && Cached.resolve<Concretion>() == Inner && 
+                Measured && Measured == 
+                Singleton.get_factory<ComplexConcretion>()->measured_graph() )
+        {
+            Result = TS_Success;
+        }
+    }
+    catch( const std::exception &e )
+    {
+        PrintException( __func__, e );
+    }
+    return Result;
+}
+
+// Slow to build, so refreshes stay open while registrations change
+struct RefreshingType : public InterfaceType
+{
+    static std::atomic<bool> Fail;
+    std::shared_ptr<Concretion> InnerInstance;
+
+    RefreshingType( std::shared_ptr<Concretion> Instance )
+        : InnerInstance( Instance )
+    {
+        if( Fail )
+        {
+            throw std::bad_exception();
+        }
+        std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+    }
+};
+
+std::atomic<bool> RefreshingType::Fail( false );
+
+// Background refreshes do not see registrations being changed, and a
+// failed refresh is thrown by the next resolve before the stale item
+// is refreshed again.
+static TestStatus TestCachedRefreshDuringRegistration()
+{
+    TestStatus Result = TS_Registration_Error;
+    ioc::container Container;
+    try
+    {
+        Container.register_type<Concretion, Concretion>();
+        Container.register_cached<InterfaceType, RefreshingType, Concretion>( 
+                std::chrono::milliseconds( 1 ) );
+        Result = TS_Resolution_Error;
+
+        const std::shared_ptr<InterfaceType> First = Container.resolve<InterfaceType>();
+        bool Refreshed = false;
+        for( int i = 0; i < 100 || ( i < 1000 && !Refreshed ); ++i )
+        {
+            if( Container.resolve<InterfaceType>() != First )
+            {
+                Refreshed = true;
+            }
+            std::ostringstream Name;
+            Name << "Registered " << i;
+            Container.register_type_with_name<Concretion, Concretion>( Name.str() );
+            std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+        }
+
+        RefreshingType::Fail = true;
+        bool Reported = false;
+        for( int i = 0; i < 1000 && !Reported; ++i )
+        {
+            std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+            try
+            {
+                Container.resolve<InterfaceType>();
+            }
+            catch( const std::bad_exception & )
+            {
+                Reported = true;
+            }
+        }
+        RefreshingType::Fail = false;
+
+        // The failure is thrown once, then the stale item is refreshed
+        const std::shared_ptr<InterfaceType> Stale = Container.resolve<InterfaceType>();
+        std::shared_ptr<InterfaceType> Recovered = Stale;
+        for( int i = 0; i < 1000 && Recovered == Stale; ++i )
+        {
+            std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+            Recovered = Container.resolve<InterfaceType>();
+        }
+
+        if( Refreshed && Reported && Stale && Recovered && Recovered != Stale )
+        {
+            Result = TS_Success;
+        }
+    }
+    catch( const std::exception &e )
+    {
+        RefreshingType::Fail = false;
+        PrintException( __func__, e );
+    }
+    return Result;
+}
+
+// Runtime type ids and dense integer keys dispatch to registrations
+// and follow later changes to them.
+static TestStatus TestRuntimeDispatch()
+{
+    TestStatus Result = TS_Registration_Error;
+    ioc::container Container;
+    try
+    {
+        Container.register_type<InterfaceType, Concretion>();
+        Container.register_type_with_name<InterfaceType, AlternateConcretion>( "Zulu" );
+        Container.register_type<Concretion, Concretion>();
+        Container.bind_key<Concretion>( 0 );
+        Container.bind_key_with_name<InterfaceType>( 2, "Zulu" );
+        Result = TS_Resolution_Error;
+
+        const ioc::resolved_item ByType = 
+            Container.resolve_any( std::type_index( typeid(InterfaceType) ) );
+        const ioc::resolved_item ByKey = Container.resolve_key( 2 );
+        const bool Dispatched = 
+            dynamic_cast<Concretion *>( ByType.as<InterfaceType>().get() ) &&
+            !ByType.as<Concretion>() &&
+            ByType.get_type() == typeid(InterfaceType) &&
+            Container.resolve_key( 0 ).as<Concretion>() &&
+            dynamic_cast<AlternateConcretion *>( ByKey.as<InterfaceType>().get() ) &&
+            Container.resolve_key( 1 ).empty() && Container.resolve_key( 7 ).empty() &&
+            Container.resolve_any( std::type_index( typeid(SettingsType) ) ).empty() &&
+            Container.resolve_id( ioc::type_ids::of<Concretion>() ).as<Concretion>() &&
+            ioc::type_ids::of<Concretion>() == 
+                ioc::type_ids::of( std::type_index( typeid(Concretion) ) ) &&
+            Container.resolve_id( ioc::type_ids::of<SettingsType>() + 1000 ).empty();
+
+        // Changes to another container leave this one's table in use
+        ioc::container Other;
+        Other.register_type<InterfaceType, AlternateConcretion>();
+        const bool Unaffected = 
+            dynamic_cast<Concretion *>( 
+                    Container.resolve_any( std::type_index( typeid(InterfaceType) ) )
+                    .as<InterfaceType>().get() ) &&
+            dynamic_cast<AlternateConcretion *>( 
+                    Other.resolve_any( std::type_index( typeid(InterfaceType) ) )
+                    .as<InterfaceType>().get() );
+
+        Container.replace_registration<InterfaceType, Concretion>( "Zulu" );
+        Container.remove_registration<Concretion>();
+        if( Dispatched && Unaffected && Container.resolve_key( 0 ).empty() &&
+                dynamic_cast<Concretion *>( 
+                    Container.resolve_key( 2 ).as<InterfaceType>().get() ) )
+        {
+            Result = TS_Success;
+        }
+    }
+    catch( const std::exception &e )
+    {
+        PrintException( __func__, e );
+    }
+    return Result;
+}
+
+// Counts the calls made through one replica of a sharded registration
+class ShardCounter
+{
+    public:
+        std::atomic<size_t> Calls;
+
+        ShardCounter() : Calls( 0 )
+        {
+        }
+};
+
+// Each thread keeps resolving its own replica of a sharded registration
+// and the visitor sees the calls made through all of them.
+static TestStatus TestShardedReplicas()
+{
+    TestStatus Result = TS_Registration_Error;
+    ioc::container Container;
+    try
+    {
+        const size_t Shards = 4;
+        const size_t Threads = 8;
+        const size_t Calls = 1000;
+        Container.register_sharded<ShardCounter, ShardCounter>( Shards );
+        Result = TS_Resolution_Error;
+
+        std::mutex Lock;
+        std::set<ShardCounter *> Seen;
+        std::atomic<size_t> Moved( 0 );
+        std::vector<std::thread> Resolvers;
+        for( size_t i = 0; i < Threads; ++i )
+        {
+            Resolvers.push_back( std::thread( [&]()
+                        {
+                            ShardCounter *First = Container.resolve<ShardCounter>().get();
+                            for( size_t j = 0; j < Calls; ++j )
+                            {
+                                std::shared_ptr<ShardCounter> Item = 
+                                    Container.resolve<ShardCounter>();
+                                Moved += Item.get() != First;
+                                ++Item->Calls;
+                            }
+                            std::lock_guard<std::mutex> Guard( Lock );
+                            Seen.insert( First );
+                        } ) );
+        }
+        for( size_t i = 0; i < Resolvers.size(); ++i )
+        {
+            Resolvers[i].join();
+        }
+
+        size_t Total = 0;
+        const size_t Visited = Container.visit_replicas<ShardCounter>( 
+                [&]( ShardCounter &Replica )
+                {
+                    Total += Replica.Calls;
+                } );
+        if( Moved == 0 && Seen.size() == Shards && Visited == Shards && 
+                Total == Threads * Calls &&
+                Container.visit_replicas_by_name<ShardCounter>( "Missing", 
+                    []( ShardCounter & ) {} ) == 0 )
+        {
+            Result = TS_Success;
+        }
+    }
+    catch( const std::exception &e )
+    {
+        PrintException( __func__, e );
+    }
+    return Result;
+}
+
+// Decorators used to check the order in which they wrap an item
+struct InnerDecorator : public InterfaceType
+{
+    std::shared_ptr<InterfaceType> Inner;
+    std::shared_ptr<Concretion> Dependency;
+
+    InnerDecorator( std::shared_ptr<InterfaceType> InnerIn, 
+            std::shared_ptr<Concretion> DependencyIn )
+        : Inner( InnerIn ), Dependency( DependencyIn )
+    {
+    }
+
+    bool Success() const
+    {
+        return Inner->Success() && Dependency;
+    }
+};
+
+struct OuterDecorator : public InterfaceType
+{
+    std::shared_ptr<InterfaceType> Inner;
+
+    OuterDecorator( std::shared_ptr<InterfaceType> InnerIn )
+        : Inner( InnerIn )
+    {
+    }
+
+    bool Success() const
+    {
+        return Inner->Success();
+    }
+};
+
+// The decorated item for an interface, or NULL if it is not wrapped
+// by an OuterDecorator around an InnerDecorator.
+static InterfaceType *Undecorate( const std::shared_ptr<InterfaceType> &Item )
+{
+    OuterDecorator *Outer = dynamic_cast<OuterDecorator *>( Item.get() );
+    InnerDecorator *Inner = Outer ? 
+        dynamic_cast<InnerDecorator *>( Outer->Inner.get() ) : NULL;
+    return Inner && Inner->Dependency ? Inner->Inner.get() : NULL;
+}
+
+// Decorators wrap existing and later registrations in order, keep
+// singletons, and leave other interfaces alone.
+static TestStatus TestDecorators()
+{
+    TestStatus Result = TS_Registration_Error;
+    ioc::container Container;
+    try
+    {
+        Container.register_type<InterfaceType, Concretion>();
+        Container.register_singleton_with_name<InterfaceType, Concretion>( "Shared" );
+        Container.register_type<Concretion, Concretion>();
+        const std::shared_ptr<InterfaceType> Shared = 
+            Container.resolve_by_name<InterfaceType>( "Shared" );
+        Container.register_decorator<InterfaceType, InnerDecorator, Concretion>();
+        Container.register_decorator<InterfaceType, OuterDecorator>();
+        Container.register_type_with_name<InterfaceType, AlternateConcretion>( "Zulu" );
+        Result = TS_Resolution_Error;
+
+        const std::shared_ptr<InterfaceType> Item = Container.resolve<InterfaceType>();
+        const std::unique_ptr<InterfaceType> Unique = 
+            Container.resolve_unique<InterfaceType>();
+        const std::shared_ptr<InterfaceType> Later = 
+            Container.resolve_by_name<InterfaceType>( "Zulu" );
+        const std::shared_ptr<Concretion> Plain = Container.resolve<Concretion>();
+        if( dynamic_cast<Concretion *>( Undecorate( Item ) ) && Item->Success() &&
+                dynamic_cast<OuterDecorator *>( Unique.get() ) &&
+                Undecorate( Container.resolve_by_name<InterfaceType>( "Shared" ) ) == 
+                Shared.get() &&
+                dynamic_cast<AlternateConcretion *>( Undecorate( Later ) ) &&
+                Plain && typeid(*Plain) == typeid(Concretion) )
+        {
+            Result = TS_Success;
+        }
+    }
+    catch( const std::exception &e )
+    {
+        PrintException( __func__, e );
+    }
+    return Result;
+}
+
+// Contextual rules bind the dependencies of one consumer type to a
+// named registration, whether the consumer is registered before or
+// after the rule, while other resolves keep the unnamed registration.
+static TestStatus TestContextualBindings()
+{
+    TestStatus Result = TS_Registration_Error;
+    ioc::container Container;
+    try
+    {
+        Container.register_type<InterfaceType, Concretion>();
+        Container.register_type_with_name<InterfaceType, AlternateConcretion>( "Zulu" );
+        Container.register_type<Concretion, Concretion>();
+        Container.register_type<CompositeType, CompositeType>();
+        Container.register_singleton_with_name<CompositeType, CompositeType>( "Shared" );
+        Container.register_contextual<CompositeType, InterfaceType>( "Zulu" );
+        Container.register_contextual<DeclaredCompositeType, InterfaceType>( "Zulu" );
+        Container.register_type<DeclaredCompositeType, DeclaredCompositeType>();
+        Result = TS_Resolution_Error;
+
+        const std::shared_ptr<CompositeType> Deduced = 
+            Container.resolve<CompositeType>();
+        const std::shared_ptr<CompositeType> Shared = 
+            Container.resolve_by_name<CompositeType>( "Shared" );
+        const std::shared_ptr<DeclaredCompositeType> Declared = 
+            Container.resolve<DeclaredCompositeType>();
+        const std::shared_ptr<InterfaceType> Elsewhere = 
+            Container.resolve<InterfaceType>();
+        if( Deduced && Shared && Declared && Elsewhere && Deduced->Concrete1 &&
+                dynamic_cast<AlternateConcretion *>( Deduced->Interface.get() ) &&
+                dynamic_cast<AlternateConcretion *>( Shared->Interface.get() ) &&
+                dynamic_cast<AlternateConcretion *>( Declared->Interface.get() ) &&
+                Container.resolve_by_name<CompositeType>( "Shared" ) == Shared &&
+                typeid(*Elsewhere) == typeid(Concretion) )
+        {
+            Result = TS_Success;
+        }
+    }
+    catch( const std::exception &e )
+    {
+        PrintException( __func__, e );
+    }
+    return Result;
+}
+
+// Depends on a handler built from the same arguments
+struct RequestScope
+{
+    std::shared_ptr<RequestHandler> Handler;
+    RequestId Id;
+
+    typedef ioc::dependencies<RequestHandler, ioc::argument<RequestId>> inject;
+
+    RequestScope( std::shared_ptr<RequestHandler> HandlerIn, RequestId IdIn )
+        : Handler( HandlerIn ), Id( IdIn )
+    {
+    }
+};
+
+// Runtime arguments reach every item of the resolved graph which
+// declares them and nothing is left registered afterwards.
+static TestStatus TestRuntimeArguments()
+{
+    TestStatus Result = TS_Registration_Error;
+    ioc::container Container;
+    try
+    {
+        Container.register_type<Concretion, Concretion>();
+        Container.register_type<RequestHandler, RequestHandler>();
+        Container.register_type_with_name<RequestScope, RequestScope>( "scope" );
+        Result = TS_Resolution_Error;
+
+        std::string User = "alice";
+        const RequestId First = { 7 };
+        const std::shared_ptr<RequestHandler> Handler = 
+            Container.resolve<RequestHandler>( First, User );
+        const RequestId Second = { 9 };
+        const std::shared_ptr<RequestScope> Scope = 
+            Container.resolve_by_name<RequestScope>( "scope", User, Second );
+
+        bool Missing = false;
+        try
+        {
+            Container.resolve<RequestHandler>();
+        }
+        catch( const ioc::resolution_exception & )
+        {
+            Missing = true;
+        }
+        if( Handler && Handler->Service && Handler->Id.Value == 7 && 
+                &Handler->User == &User && Scope && Scope->Id.Value == 9 && 
+                Scope->Handler->Id.Value == 9 && Missing &&
+                !Container.type_is_registered<RequestId>() )
+        {
+            Result = TS_Success;
+        }
+    }
+    catch( const std::exception &e )
+    {
+        PrintException( __func__, e );
+    }
+    return Result;
+}
+
+// Pooled registrations are filled in the background from their first
+// resolve, hand each resolve its own ready item and build one when
+// none are.
+static TestStatus TestPooledRegistrations()
+{
+    TestStatus Result = TS_Registration_Error;
+    ioc::container Container;
+    try
+    {
+        Container.register_pooled<InterfaceType, Concretion>( 2, 4 );
+        Container.register_pooled_with_name<InterfaceType, AlternateConcretion>( 
+                "empty", 0, 0 );
+        Result = TS_Resolution_Error;
+
+        // Registering builds nothing
+        const ioc::pool_statistics Idle = Container.get_pool_statistics<InterfaceType>();
+        const std::shared_ptr<InterfaceType> Starter = Container.resolve<InterfaceType>();
+        ioc::pool_statistics Warm = Container.get_pool_statistics<InterfaceType>();
+        for( int i = 0; i < 1000 && Warm.ready < 4; ++i )
+        {
+            std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+            Warm = Container.get_pool_statistics<InterfaceType>();
+        }
+        const std::shared_ptr<InterfaceType> First = Container.resolve<InterfaceType>();
+        const std::shared_ptr<InterfaceType> Second = Container.resolve<InterfaceType>();
+        const ioc::pool_statistics Used = Container.get_pool_statistics<InterfaceType>();
+
+        const std::shared_ptr<InterfaceType> Built = 
+            Container.resolve_by_name<InterfaceType>( "empty" );
+        const ioc::pool_statistics Empty = 
+            Container.get_pool_statistics_by_name<InterfaceType>( "empty" );
+        if( Idle.high_watermark == 0 && Starter && Starter->Success() &&
+                Warm.ready == 4 && Warm.low_watermark == 2 && Warm.high_watermark == 4 &&
+                First && Second && First != Second && First->Success() &&
+                Used.hits == 2 && Used.misses == 1 &&
+                Built && Built->Success() && Empty.hits == 0 && Empty.misses == 1 &&
+                Container.get_pool_statistics<Concretion>().high_watermark == 0 )
+        {
+            Result = TS_Success;
+        }
+    }
+    catch( const std::exception &e )
+    {
+        PrintException( __func__, e );
+    }
+    return Result;
+}
+
+// Fails whenever it is built away from the thread resolving it
+struct ResolverThreadType : public InterfaceType
+{
+    static std::thread::id Resolver;
+
+    ResolverThreadType()
+    {
+        if( std::this_thread::get_id() != Resolver )
+        {
+            throw std::bad_exception();
+        }
+    }
+};
+
+std::thread::id ResolverThreadType::Resolver;
+
+// Pools are only filled once resolved, so their items see dependencies
+// registered after the pool. A failed background build is thrown by
+// the next resolve.
+static TestStatus TestPooledLateDependencies()
+{
+    TestStatus Result = TS_Registration_Error;
+    ioc::container Container;
+    try
+    {
+        Container.register_pooled<ComplexConcretion, ComplexConcretion, Concretion>( 4, 8 );
+        Container.register_type<Concretion, Concretion>();
+        ResolverThreadType::Resolver = std::this_thread::get_id();
+        Container.register_pooled<InterfaceType, ResolverThreadType>( 1, 2 );
+        Result = TS_Resolution_Error;
+
+        Container.resolve<ComplexConcretion>();
+        for( int i = 0; i < 1000 && 
+                Container.get_pool_statistics<ComplexConcretion>().ready < 8; ++i )
+        {
+            std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+        }
+        size_t Complete = 0;
+        for( int i = 0; i < 8; ++i )
+        {
+            const std::shared_ptr<ComplexConcretion> Item = 
+                Container.resolve<ComplexConcretion>();
+            Complete += Item && Item->InnerInstance ? 1 : 0;
+        }
+        const ioc::pool_statistics Used = 
+            Container.get_pool_statistics<ComplexConcretion>();
+
+        // Resolves build their own items until the failure is seen
+        bool Reported = false;
+        for( int i = 0; i < 1000 && !Reported; ++i )
+        {
+            try
+            {
+                Container.resolve<InterfaceType>();
+                std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+            }
+            catch( const std::bad_exception & )
+            {
+                Reported = true;
+            }
+        }
+        if( Complete == 8 && Used.hits == 8 && Reported )
+        {
+            Result = TS_Success;
+        }
+    }
+    catch( const std::exception &e )
+    {
+        PrintException( __func__, e );
+    }
+    return Result;
+}
+
+// Interface template with one implementation template for every
+// item type
+template<typename T>
+struct RepositoryType
+{
+    virtual ~RepositoryType()
+    {
+    }
+
+    virtual size_t ItemSize() const = 0;
+};
+
+template<typename T>
+struct MemoryRepository : public RepositoryType<T>
+{
+    size_t ItemSize() const
+    {
+        return sizeof(T);
+    }
+};
+
+IOC_GENERIC_IMPLEMENTATION( RepositoryType, MemoryRepository );
+
+// Consumer of an instantiation that is never registered explicitly
+struct RepositoryUser
+{
+    std::shared_ptr<RepositoryType<double>> Repository;
+
+    RepositoryUser( std::shared_ptr<RepositoryType<double>> RepositoryIn )
+        : Repository( RepositoryIn )
+    {
+    }
+};
+
+// Generic registrations make the factory of an instantiation the
+// first time it is resolved, directly or as a dependency, and keep it.
+static TestStatus TestGenericRegistrations()
+{
+    TestStatus Result = TS_Registration_Error;
+    ioc::container Container;
+    try
+    {
+        Container.register_generic<RepositoryType>();
+        Container.register_generic_singleton_with_name<RepositoryType>( "shared" );
+        Container.register_type<RepositoryUser, RepositoryUser>();
+        const bool Lazy = !Container.type_is_registered<RepositoryType<int>>();
+        Result = TS_Resolution_Error;
+
+        const std::shared_ptr<RepositoryType<int>> Ints = 
+            Container.resolve<RepositoryType<int>>();
+        const std::shared_ptr<RepositoryType<char>> Shared = 
+            Container.resolve_by_name<RepositoryType<char>>( "shared" );
+        const std::shared_ptr<RepositoryUser> User = Container.resolve<RepositoryUser>();
+        if( Lazy && Ints && Ints->ItemSize() == sizeof(int) &&
+                Container.type_is_registered<RepositoryType<int>>() &&
+                Container.type_is_registered<RepositoryType<int>>( "shared" ) &&
+                !Container.type_is_registered<RepositoryType<long>>() &&
+                Shared && Shared->ItemSize() == 1 &&
+                Container.resolve_by_name<RepositoryType<char>>( "shared" ) == Shared &&
+                Container.resolve<RepositoryType<char>>() != Shared &&
+                User && User->Repository && User->Repository->ItemSize() == sizeof(double) &&
+                !Container.resolve<InterfaceType>() )
+        {
+            Result = TS_Success;
+        }
+    }
+    catch( const std::exception &e )
+    {
+        PrintException( __func__, e );
+    }
+    return Result;
+}
+
+// Tags giving each thread of TestConcurrentGenericInstantiation the
+// same set of distinct instantiations to race on
+template<int N>
+struct RepositoryTag
+{
+    char Item[N + 1];
+};
+
+typedef bool (*TaggedResolver)( const ioc::container &, const void *& );
+
+template<int N>
+static bool ResolveTaggedRepository( const ioc::container &Container, const void *&Shared )
+{
+    typedef RepositoryType<RepositoryTag<N>> Repository;
+    const std::shared_ptr<Repository> Plain = Container.resolve<Repository>();
+    const std::shared_ptr<Repository> Named = 
+        Container.resolve_by_name<Repository>( "shared" );
+    Shared = Named.get();
+    return Plain && Plain->ItemSize() == N + 1 && 
+        Named && Named->ItemSize() == N + 1 && Plain != Named;
+}
+
+// Threads resolving instantiations for the first time all at once
+// each get a working instantiation and share its singleton.
+static TestStatus TestConcurrentGenericInstantiation()
+{
+    TestStatus Result = TS_Registration_Error;
+    ioc::container Container;
+    try
+    {
+        Container.register_generic<RepositoryType>();
+        Container.register_generic_singleton_with_name<RepositoryType>( "shared" );
+        Result = TS_Resolution_Error;
+
+        static const TaggedResolver Resolvers[] =
+        {
+            ResolveTaggedRepository<0>, ResolveTaggedRepository<1>,
+            ResolveTaggedRepository<2>, ResolveTaggedRepository<3>,
+            ResolveTaggedRepository<4>, ResolveTaggedRepository<5>,
+            ResolveTaggedRepository<6>, ResolveTaggedRepository<7>
+        };
+        const size_t TagCount = sizeof(Resolvers) / sizeof(Resolvers[0]);
+        const size_t ThreadCount = 8;
+        std::vector<const void *> Shared( ThreadCount * TagCount, NULL );
+        std::atomic<size_t> Waiting( ThreadCount );
+        std::atomic<size_t> Failed( 0 );
+        std::vector<std::thread> Threads;
+        for( size_t t = 0; t < ThreadCount; ++t )
+        {
+            Threads.push_back( std::thread( [&, t]()
+                        {
+                            --Waiting;
+                            while( Waiting )
+                            {
+                                std::this_thread::yield();
+                            }
+                            // Each thread starts on a different tag
+                            for( size_t i = 0; i < TagCount; ++i )
+                            {
+                                const size_t Tag = ( t + i ) % TagCount;
+                                if( !Resolvers[Tag]( Container, Shared[t * TagCount + Tag] ) )
+                                {
+                                    ++Failed;
+                                }
+                            }
+                        } ) );
+        }
+        for( size_t t = 0; t < Threads.size(); ++t )
+        {
+            Threads[t].join();
+        }
+
+        bool SameSingletons = true;
+        for( size_t t = 1; t < ThreadCount; ++t )
+        {
+            for( size_t i = 0; i < TagCount; ++i )
+            {
+                SameSingletons = SameSingletons && Shared[t * TagCount + i] == Shared[i];
+            }
+        }
+        if( Failed == 0 && SameSingletons &&
+                Container.type_is_registered<RepositoryType<RepositoryTag<7>>>( "shared" ) )
+        {
+            Result = TS_Success;
+        }
+    }
+    catch( const std::exception &e )
+    {
+        PrintException( __func__, e );
+    }
+    return Result;
+}
+
+// A text manifest compiled to a file and mapped back in registers
+// the implementations it chooses from a catalogue in one step.
+static TestStatus TestManifestWiring()
+{
+    TestStatus Result = TS_Registration_Error;
+    ioc::container Container;
+    const std::string Path = "test_manifest.bin";
+    try
+    {
+        ioc::catalogue Catalogue;
+        Catalogue.add<InterfaceType, Concretion>( "interface", "default" );
+        Catalogue.add<InterfaceType, AlternateConcretion>( "interface", "alternate" );
+        Catalogue.add_singleton<Concretion, Concretion>( "concrete", "shared" );
+
+        std::istringstream Text( 
+                "# Wiring for a test environment\n"
+                "interface alternate\n"
+                "\n"
+                "interface default Zulu\n"
+                "concrete shared\n" );
+        {
+            std::ofstream File( Path.c_str(), std::ios::out | std::ios::binary );
+            ioc::compile_manifest( Text, File );
+        }
+        std::ostringstream Unknown;
+        std::istringstream UnknownText( "interface missing\n" );
+        ioc::compile_manifest( UnknownText, Unknown );
+        const std::string UnknownBinary = Unknown.str();
+
+        const ioc::manifest Manifest( Path );
+        Catalogue.apply( Manifest, Container );
+        bool Rejected = false;
+        try
+        {
+            Catalogue.apply( ioc::manifest( UnknownBinary.data(), UnknownBinary.size() ), 
+                    Container );
+        }
+        catch( const ioc::manifest_exception & )
+        {
+            Rejected = true;
+        }
+        Result = TS_Resolution_Error;
+
+        if( Manifest.size() == 3 && Rejected &&
+                dynamic_cast<AlternateConcretion *>( 
+                    Container.resolve<InterfaceType>().get() ) &&
+                dynamic_cast<Concretion *>( 
+                    Container.resolve_by_name<InterfaceType>( "Zulu" ).get() ) &&
+                Container.resolve<Concretion>() == Container.resolve<Concretion>() )
+        {
+            Result = TS_Success;
+        }
+    }
+    catch( const std::exception &e )
+    {
+        PrintException( __func__, e );
+    }
+    std::remove( Path.c_str() );
+    return Result;
+}
+
 // Helper macro for registering tests with a name.
 #define REGISTER_TEST( v, x ) ( v.push_back( TestFunctionObject( #x, &x ) ) ) 
 // Register all test functions within this function
@@ -590,6 +2827,45 @@ static std::vector<TestFunctionObject> GetRegisteredTests()
     REGISTER_TEST( Result, TestRemoveRegistrationByName );
     REGISTER_TEST( Result, TestRegisterDelegate );
     REGISTER_TEST( Result, TestRegisterDelegateWithName );
+    REGISTER_TEST( Result, TestSnapshotFork );
+    REGISTER_TEST( Result, TestSnapshotRemoveRegistration );
+    REGISTER_TEST( Result, TestRegisterTypeDeducesConstructor );
+    REGISTER_TEST( Result, TestRegisterTypeUsesInjectTypedef );
+    REGISTER_TEST( Result, TestResolveInstance );
+    REGISTER_TEST( Result, TestInjectByOwnershipKind );
+    REGISTER_TEST( Result, TestInjectReferenceToTransientThrows );
+    REGISTER_TEST( Result, TestThreadCacheInvalidation );
+    REGISTER_TEST( Result, TestThreadCacheReleasedWithContainer );
+    REGISTER_TEST( Result, TestRegisterSingleton );
+    REGISTER_TEST( Result, TestTeardownDependencyOrder );
+    REGISTER_TEST( Result, TestTeardownParallelWithDeadline );
+    REGISTER_TEST( Result, TestReplaceRegistrationUnderLoad );
+    REGISTER_TEST( Result, TestReplacedSingletonChangesRegistry );
+    REGISTER_TEST( Result, TestMemoryUsage );
+    REGISTER_TEST( Result, TestRegisterBatch );
+    REGISTER_TEST( Result, TestGraphAllocation );
+    REGISTER_TEST( Result, TestDeferredDestruction );
+    REGISTER_TEST( Result, TestResolveAllocationBudgets );
+    REGISTER_TEST( Result, TestResolveTracing );
+    REGISTER_TEST( Result, TestCachedLifetimeRefresh );
+    REGISTER_TEST( Result, TestCachedLifetimeEviction );
+    REGISTER_TEST( Result, TestCachedLifetimeOutsideGraph );
+    REGISTER_TEST( Result, TestCachedRefreshDuringRegistration );
+    REGISTER_TEST( Result, TestRuntimeDispatch );
+    REGISTER_TEST( Result, TestShardedReplicas );
+    REGISTER_TEST( Result, TestDecorators );
+    REGISTER_TEST( Result, TestContextualBindings );
+    REGISTER_TEST( Result, TestGenericRegistrations );
+    REGISTER_TEST( Result, TestConcurrentGenericInstantiation );
+    REGISTER_TEST( Result, TestPooledRegistrations );
+    REGISTER_TEST( Result, TestPooledLateDependencies );
+    REGISTER_TEST( Result, TestRuntimeArguments );
+    REGISTER_TEST( Result, TestManifestWiring );
+#if defined(__cpp_impl_coroutine)
+    REGISTER_TEST( Result, TestCoResolveConcurrentDependencies );
+    REGISTER_TEST( Result, TestCoResolveMixedRegistrations );
+    REGISTER_TEST( Result, TestCoResolveReplacedWhileSuspended );
+#endif
     return Result;
 }
 #undef REGISTER_TEST
@@ -0,0 +1,38 @@
+/*
+ * manifest_compiler.cpp - Converts a text manifest into the binary
+ * form applied by ioc::catalogue
+ *
+ * Copyright (c) 2012 Nicholas A. Smith (nickrmc83@gmail.com)
+ * Distributed under the Boost software license 1.0,
+ * see boost.org for a copy.
+ */
+
+#include <ioc_container/ioc_manifest.h>
+#include <fstream>
+#include <iostream>
+
+int main( int argc, char **argv )
+{
+    if( argc != 3 )
+    {
+        std::cerr << "Usage: " << argv[0] << " <text manifest> <binary manifest>" << std::endl;
+        return 2;
+    }
+    std::ifstream Input( argv[1] );
+    if( !Input )
+    {
+        std::cerr << "Cannot open " << argv[1] << std::endl;
+        return 1;
+    }
+    std::ofstream Output( argv[2], std::ios::out | std::ios::binary );
+    try
+    {
+        ioc::compile_manifest( Input, Output );
+    }
+    catch( const std::exception &e )
+    {
+        std::cerr << argv[1] << ": " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}